@@ -0,0 +1,188 @@
+/*
+	# Allocation accounting
+
+	Compile with -DWIKA_ALLOC_STATS to count every call to operator new and
+	delete, by phase (lexer, parser, ...) and by tagged call site, and to
+	print a summary to standard error at exit:
+	```
+		g++ -O2 -DWIKA_ALLOC_STATS parser.cpp -o wika-alloc
+	```
+	Without it ALLOCATION_PHASE() and ALLOCATION_SITE() compile to nothing.
+*/
+
+#ifndef WIKA_ALLOCATIONS_HPP
+#define WIKA_ALLOCATIONS_HPP
+
+enum AllocationPhase
+{
+	PHASE_STARTUP,
+	PHASE_LEXER,
+	PHASE_PARSER,
+	PHASE_SEMANTIC,
+	PHASE_OUTPUT,
+	PHASE_PROGRAM,
+	PHASE_COUNT
+};
+
+#ifdef WIKA_ALLOC_STATS
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+struct AllocationCounter
+{
+	atomic<size_t> allocations;
+	atomic<size_t> bytes;
+	atomic<size_t> frees;
+};
+
+const char *allocationPhaseNames[] = {"startup", "lexer", "parser", "semantic", "output", "program"};
+const int maxAllocationSites = 64;
+
+AllocationCounter phaseAllocations[PHASE_COUNT];
+AllocationCounter siteAllocations[maxAllocationSites];
+const char *allocationSiteNames[maxAllocationSites];
+int allocationSiteCount = 0;
+mutex allocationSiteLock;
+
+// The phase is shared with worker threads; a call site is tagged per thread
+atomic<int> allocationPhase(PHASE_STARTUP);
+thread_local int allocationSite = -1;
+
+// Sites with the same name, such as one in each instantiation of a
+// template, share one counter
+int registerAllocationSite(const char *name)
+{
+	lock_guard<mutex> held(allocationSiteLock);
+	for (int site = 0; site < allocationSiteCount; site++)
+	{
+		if (strcmp(allocationSiteNames[site], name) == 0)
+			return site;
+	}
+	if (allocationSiteCount == maxAllocationSites)
+		return -1;
+	allocationSiteNames[allocationSiteCount] = name;
+	return allocationSiteCount++;
+}
+
+// Tags the allocations of the enclosing scope, then restores the outer tag
+struct AllocationSite
+{
+	int saved;
+	AllocationSite(int site) : saved(allocationSite) { allocationSite = site; }
+	~AllocationSite() { allocationSite = saved; }
+};
+
+void countAllocation(size_t size)
+{
+	AllocationCounter &phase = phaseAllocations[allocationPhase.load(memory_order_relaxed)];
+	phase.allocations.fetch_add(1, memory_order_relaxed);
+	phase.bytes.fetch_add(size, memory_order_relaxed);
+	if (allocationSite >= 0)
+	{
+		siteAllocations[allocationSite].allocations.fetch_add(1, memory_order_relaxed);
+		siteAllocations[allocationSite].bytes.fetch_add(size, memory_order_relaxed);
+	}
+}
+
+// A free is counted where it happens, which may be a later phase than the
+// allocation it releases
+void countFree()
+{
+	phaseAllocations[allocationPhase.load(memory_order_relaxed)].frees.fetch_add(1, memory_order_relaxed);
+	if (allocationSite >= 0)
+		siteAllocations[allocationSite].frees.fetch_add(1, memory_order_relaxed);
+}
+
+void *operator new(size_t size)
+{
+	countAllocation(size);
+	void *block = malloc(size > 0 ? size : 1);
+	if (block == nullptr)
+		throw bad_alloc();
+	return block;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(size_t size, const nothrow_t &) noexcept
+{
+	countAllocation(size);
+	return malloc(size > 0 ? size : 1);
+}
+
+void *operator new[](size_t size, const nothrow_t &) noexcept
+{
+	return operator new(size, nothrow);
+}
+
+void operator delete(void *block) noexcept
+{
+	if (block == nullptr)
+		return;
+	countFree();
+	free(block);
+}
+
+void operator delete[](void *block) noexcept
+{
+	operator delete(block);
+}
+
+void operator delete(void *block, size_t) noexcept
+{
+	operator delete(block);
+}
+
+void operator delete[](void *block, size_t) noexcept
+{
+	operator delete(block);
+}
+
+void printAllocationRow(const char *name, const AllocationCounter &counter)
+{
+	fprintf(stderr, "%-32s%14zu%16zu%14zu\n", name, counter.allocations.load(), counter.bytes.load(), counter.frees.load());
+}
+
+void printAllocations()
+{
+	fprintf(stderr, "\n%-32s%14s%16s%14s\n", "PHASE", "ALLOCATIONS", "BYTES", "FREES");
+	for (int phase = 0; phase < PHASE_COUNT; phase++)
+	{
+		printAllocationRow(allocationPhaseNames[phase], phaseAllocations[phase]);
+	}
+	fprintf(stderr, "\n%-32s%14s%16s%14s\n", "CALL SITE", "ALLOCATIONS", "BYTES", "FREES");
+	for (int site = 0; site < allocationSiteCount; site++)
+	{
+		printAllocationRow(allocationSiteNames[site], siteAllocations[site]);
+	}
+}
+
+// Prints the summary when the program exits, after main() has returned
+struct AllocationReport
+{
+	~AllocationReport() { printAllocations(); }
+} allocationReport;
+
+#define ALLOCATION_PHASE(phase) allocationPhase.store(phase, memory_order_relaxed)
+#define ALLOCATION_SITE(name)                                                \
+	static const int allocationSiteId = registerAllocationSite(name); \
+	AllocationSite allocationSiteScope(allocationSiteId)
+
+#else
+
+#define ALLOCATION_PHASE(phase)
+#define ALLOCATION_SITE(name)
+
+#endif
+
+#endif
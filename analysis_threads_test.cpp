@@ -0,0 +1,114 @@
+/*
+	# Stress test for concurrent analyses
+
+	Runs the same full analysis (lexer, parser, semantic pass, symbol table
+	and statement report) on several threads at once, each with its own
+	Analysis and its own output buffers, and checks that every thread
+	produces the output of a single run. Build it with ThreadSanitizer so
+	any state the analyses still share is reported:
+	```
+		g++ -std=c++17 -g -O1 -fsanitize=thread analysis_threads_test.cpp -o analysis_threads_test
+		./analysis_threads_test [threads] [rounds]
+	```
+	Exits with 0 when every run matched.
+*/
+
+#include <sstream>
+#define WIKA_NO_MAIN
+#include "parser.cpp"
+
+// Declarations, assignments, blocks, comments and lexical errors, so every
+// part of the analysis has something to do
+const char *stressSource = R"(buumbilang bilang = 10;
+bahagimbilang presyo = 2.5e3;
+string pangalan = "Juan dela Cruz";
+bool ayTama = tama;
+karakter titik = 65;
+bilang = presyo;
+pangalan = bilang;
+hindiIdeklara = 3;
+{
+	buumbilang bilang = 1;
+	// komento na may ñ
+}
+buumbilang bilang;
+/* mahabang
+   komento */
+buumbilang x = 99999999999999999999;
+string sira = "walang dulo
+buumbilang y = 1 @ 2;
+caf)" "\xe9"
+R"( = 1;
+)";
+
+// Returns the symbol table, diagnostics and statement report of one analysis
+string analyzeOnce(const string &input)
+{
+	Analysis analysis = analysisOf(&defaultAnalysis, "stress.wika", "");
+	vector<Token> tokens = tokenize<ReportLexer>(&analysis, input);
+	vector<Statement> statements = parse(&analysis, &tokens);
+	analyze(&tokens, &statements);
+
+	string out = lineSymbolTableHeader;
+	size_t line = 1;
+	for (size_t i = 0; i < tokens.size(); i++)
+	{
+		line = advanceLine(&analysis.lines, line, tokens[i].offset);
+		appendTokenRow(&out, tokens[i], i, line);
+	}
+	ostringstream diagnostics;
+	printDiagnostics(&analysis, input, diagnostics, stderr);
+	out += diagnostics.str();
+	for (const Statement &statement : statements)
+	{
+		out += to_string(statement.line) + "\t" + statement.syntax + "\t" + (statement.validity ? "Valid" : "Invalid") + "\t" + statement.message + "\n";
+	}
+	return out;
+}
+
+int main(int argc, char *argv[])
+{
+	int threads = argc > 1 ? atoi(argv[1]) : max(2, (int)thread::hardware_concurrency());
+	int rounds = argc > 2 ? atoi(argv[2]) : 2;
+
+	// large enough that parse() also splits the tokens between threads
+	string input;
+	while (input.size() < 768 * 1024)
+	{
+		input += stressSource;
+	}
+	string expected = analyzeOnce(input);
+
+	// threads of its own rather than parallelFor(), whose pool may have
+	// fewer workers, so every analysis really runs at the same time
+	vector<int> mismatches(threads, 0);
+	vector<thread> workers;
+	for (int t = 0; t < threads; t++)
+	{
+		workers.emplace_back([&, t] {
+			for (int round = 0; round < rounds; round++)
+			{
+				// each thread analyzes its own copy of the input
+				string copy = input;
+				if (analyzeOnce(copy) != expected)
+					mismatches[t]++;
+			}
+		});
+	}
+	for (thread &worker : workers)
+	{
+		worker.join();
+	}
+
+	int failed = 0;
+	for (int t = 0; t < threads; t++)
+	{
+		if (mismatches[t] > 0)
+		{
+			cout << "thread " << t << ": " << mismatches[t] << " of " << rounds << " analyses differ from the single run" << endl;
+			failed++;
+		}
+	}
+	cout << ">> " << threads << " threads x " << rounds << " analyses of " << input.size() << " bytes: " << (failed == 0 ? "ok" : "FAILED") << endl;
+	return failed == 0 ? 0 : 1;
+}
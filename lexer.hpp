@@ -0,0 +1,972 @@
+/*
+	# Lexer shared by lexer.cpp and parser.cpp
+
+	Header only: each program includes it once and picks the lexer policies
+	it needs (see tokenizeInto()). Everything an analysis changes is kept in
+	its Analysis, so any number of inputs can be analyzed at once, one per
+	thread, without locks.
+*/
+
+#ifndef WIKA_LEXER_HPP
+#define WIKA_LEXER_HPP
+
+#include <iostream>
+#include <unordered_map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "allocations.hpp"
+
+using namespace std;
+
+/*============================ UTF-8 ========================================================================*/
+
+// Length of the well-formed UTF-8 sequence at bytes[i], or 0 when the bytes
+// there are not one. The lead byte decides the length and the range allowed
+// for the second byte, which rules out overlong forms, surrogates and values
+// past U+10FFFF. For a bad sequence, *bad is the number of bytes to skip: the
+// lead byte and the continuation bytes that still fit it.
+int sequenceLength(const unsigned char *bytes, size_t n, size_t i, int *bad)
+{
+	unsigned char b = bytes[i];
+	if (b < 0x80)
+		return 1;
+	int length;
+	unsigned char low = 0x80, high = 0xBF;
+	if (b >= 0xC2 && b <= 0xDF)
+		length = 2;
+	else if (b >= 0xE0 && b <= 0xEF)
+	{
+		length = 3;
+		if (b == 0xE0)
+			low = 0xA0;
+		else if (b == 0xED)
+			high = 0x9F;
+	}
+	else if (b >= 0xF0 && b <= 0xF4)
+	{
+		length = 4;
+		if (b == 0xF0)
+			low = 0x90;
+		else if (b == 0xF4)
+			high = 0x8F;
+	}
+	else
+	{
+		*bad = 1;
+		return 0;
+	}
+
+	*bad = 1;
+	if (i + 1 >= n || bytes[i + 1] < low || bytes[i + 1] > high)
+		return 0;
+	for (int k = 2; k < length; k++)
+	{
+		*bad = k;
+		if (i + k >= n || (bytes[i + k] & 0xC0) != 0x80)
+			return 0;
+	}
+	return length;
+}
+
+// Decodes the code point starting at input[i], which must be valid UTF-8
+uint32_t decodeUtf8(string_view input, size_t i, int *length)
+{
+	unsigned char b = input[i];
+	if (b < 0x80)
+	{
+		*length = 1;
+		return b;
+	}
+	if (b < 0xE0)
+	{
+		*length = 2;
+		return ((b & 0x1F) << 6) | (input[i + 1] & 0x3F);
+	}
+	if (b < 0xF0)
+	{
+		*length = 3;
+		return ((b & 0x0F) << 12) | ((input[i + 1] & 0x3F) << 6) | (input[i + 2] & 0x3F);
+	}
+	*length = 4;
+	return ((b & 0x07) << 18) | ((input[i + 1] & 0x3F) << 12) | ((input[i + 2] & 0x3F) << 6) | (input[i + 3] & 0x3F);
+}
+
+// Letters outside ASCII that may appear in identifiers: Latin (including
+// ñ and accented vowels), Greek, Cyrillic, Armenian, Hebrew, Arabic,
+// Devanagari, Baybayin, Hangul, kana and CJK ideographs
+const uint32_t unicodeLetters[][2] = {
+	{0x00AA, 0x00AA}, {0x00B5, 0x00B5}, {0x00BA, 0x00BA}, {0x00C0, 0x00D6},
+	{0x00D8, 0x00F6}, {0x00F8, 0x02C1}, {0x02C6, 0x02D1}, {0x02E0, 0x02E4},
+	{0x0370, 0x0373}, {0x0376, 0x0377}, {0x037B, 0x037D}, {0x0386, 0x0386},
+	{0x0388, 0x03F5}, {0x03F7, 0x0481}, {0x048A, 0x052F}, {0x0531, 0x0556},
+	{0x0561, 0x0587}, {0x05D0, 0x05EA}, {0x0620, 0x064A}, {0x0904, 0x0939},
+	{0x1700, 0x1711}, {0x171F, 0x171F}, {0x1E00, 0x1FBC}, {0x3041, 0x3096},
+	{0x30A1, 0x30FA}, {0x4E00, 0x9FFF}, {0xAC00, 0xD7A3},
+};
+
+// Combining marks that may follow a letter, such as U+0303 in a decomposed ñ
+// and the Baybayin vowel signs
+const uint32_t unicodeMarks[][2] = {
+	{0x0300, 0x036F}, {0x0483, 0x0487}, {0x093A, 0x094F}, {0x1712, 0x1715},
+	{0x1DC0, 0x1DFF}, {0x20D0, 0x20FF},
+};
+
+template <size_t N>
+bool inRanges(const uint32_t (&ranges)[N][2], uint32_t codePoint)
+{
+	size_t low = 0, high = N;
+	while (low < high)
+	{
+		size_t mid = (low + high) / 2;
+		if (codePoint < ranges[mid][0])
+			high = mid;
+		else if (codePoint > ranges[mid][1])
+			low = mid + 1;
+		else
+			return true;
+	}
+	return false;
+}
+
+// Number of characters in valid UTF-8 text
+size_t countCodePoints(string_view text)
+{
+	size_t count = 0;
+	for (char c : text)
+	{
+		if (((unsigned char)c & 0xC0) != 0x80)
+			count++;
+	}
+	return count;
+}
+
+bool isUnicodeLetter(uint32_t codePoint)
+{
+	return inRanges(unicodeLetters, codePoint);
+}
+
+bool isUnicodeMark(uint32_t codePoint)
+{
+	return inRanges(unicodeMarks, codePoint);
+}
+
+/*============================ LINE INDEX ===================================================================*/
+
+// Tokens and diagnostics only record byte offsets. The offsets where lines
+// start are collected by one scan of the input the first time a line is
+// asked for, and each lookup after that is a binary search.
+struct LineIndex
+{
+	string_view input;
+	vector<size_t> starts;
+	bool built;
+};
+
+// Called whenever a new input is tokenized
+void indexLines(LineIndex *lines, string_view input)
+{
+	lines->input = input;
+	lines->starts.clear();
+	lines->built = false;
+}
+
+// Threads that share an index must build it before they start
+void buildLineIndex(LineIndex *lines)
+{
+	const char *bytes = lines->input.data();
+	size_t n = lines->input.size();
+	vector<size_t> &starts = lines->starts;
+	starts.assign(1, 0);
+	size_t i = 0;
+#ifdef __SSE2__
+	// compare 16 bytes at a time against '\n' and walk the set bits
+	const __m128i newline = _mm_set1_epi8('\n');
+	for (; i + 16 <= n; i += 16)
+	{
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bytes + i)), newline));
+		while (mask != 0)
+		{
+			starts.push_back(i + __builtin_ctz(mask) + 1);
+			mask &= mask - 1;
+		}
+	}
+#endif
+	while (i < n)
+	{
+		const char *found = (const char *)memchr(bytes + i, '\n', n - i);
+		if (found == nullptr)
+			break;
+		i = found - bytes + 1;
+		starts.push_back(i);
+	}
+	lines->built = true;
+}
+
+// 1-based line holding the byte at offset
+size_t lineAt(LineIndex *lines, size_t offset)
+{
+	if (!lines->built)
+		buildLineIndex(lines);
+	return upper_bound(lines->starts.begin(), lines->starts.end(), offset) - lines->starts.begin();
+}
+
+// 1-based column in characters, counting a multi-byte UTF-8 sequence once
+size_t columnAt(LineIndex *lines, size_t offset)
+{
+	size_t column = 1;
+	for (size_t i = lines->starts[lineAt(lines, offset) - 1]; i < offset && i < lines->input.size(); i++)
+	{
+		if (((unsigned char)lines->input[i] & 0xC0) != 0x80)
+			column++;
+	}
+	return column;
+}
+
+// Line of the first token at or after offset when the previous token was
+// on line; tokens come in input order, so this avoids a search per token
+size_t advanceLine(const LineIndex *lines, size_t line, size_t offset)
+{
+	while (line < lines->starts.size() && lines->starts[line] <= offset)
+	{
+		line++;
+	}
+	return line;
+}
+
+/*============================ LIMITS =======================================================================*/
+
+// Bounds on what one input may cost, for input that cannot be trusted. A
+// limit of 0 is off. The byte, token, nesting and time limits stop the lexer
+// where they are reached; a long identifier or string is reported and
+// lexing goes on. Identifiers follow rule 1 of README.md by default.
+struct Limits
+{
+	size_t maxBytes;
+	size_t maxTokens;
+	size_t maxIdentifier; // in characters
+	size_t maxString;	  // in characters
+	size_t maxDepth;	  // open ( [ { and, in the program parser, nested constructs
+	long long timeout;	  // in milliseconds, from startClock()
+	chrono::steady_clock::time_point deadline;
+};
+
+// Called before each input is analyzed
+void startClock(Limits *limits)
+{
+	if (limits->timeout > 0)
+		limits->deadline = chrono::steady_clock::now() + chrono::milliseconds(limits->timeout);
+}
+
+bool pastDeadline(const Limits *limits)
+{
+	return chrono::steady_clock::now() > limits->deadline;
+}
+
+/*============================ DIAGNOSTICS ==================================================================*/
+
+enum DiagnosticCode
+{
+	DIAG_INVALID_UTF8,
+	DIAG_UNRECOGNIZED_TOKEN,
+	DIAG_UNTERMINATED_COMMENT,
+	DIAG_UNTERMINATED_STRING,
+	DIAG_NUMBER_OUT_OF_RANGE,
+	DIAG_INPUT_TOO_LARGE,
+	DIAG_TOO_MANY_TOKENS,
+	DIAG_IDENTIFIER_TOO_LONG,
+	DIAG_STRING_TOO_LONG,
+	DIAG_NESTING_TOO_DEEP,
+	DIAG_TIME_LIMIT
+};
+
+const char *diagnosticMessages[] = {
+	"invalid UTF-8 byte",
+	"unrecognized token",
+	"missing terminating */",
+	"missing terminating \" character",
+	"numeric constant out of range",
+	"input too large",
+	"too many tokens",
+	"identifier too long",
+	"string literal too long",
+	"brackets nested too deep",
+	"time limit exceeded",
+};
+
+// The limit behind a diagnostic, such as " (limit 31 characters)", or ""
+string limitOf(const Limits *limits, uint16_t code)
+{
+	switch (code)
+	{
+	case DIAG_INPUT_TOO_LARGE:
+		return " (limit " + to_string(limits->maxBytes) + " bytes)";
+	case DIAG_TOO_MANY_TOKENS:
+		return " (limit " + to_string(limits->maxTokens) + ")";
+	case DIAG_IDENTIFIER_TOO_LONG:
+		return " (limit " + to_string(limits->maxIdentifier) + " characters)";
+	case DIAG_STRING_TOO_LONG:
+		return " (limit " + to_string(limits->maxString) + " characters)";
+	case DIAG_NESTING_TOO_DEEP:
+		return " (limit " + to_string(limits->maxDepth) + ")";
+	case DIAG_TIME_LIMIT:
+		return " (limit " + to_string(limits->timeout) + " ms)";
+	}
+	return "";
+}
+
+// A diagnostic only records where it happened; the source text it quotes
+// and its column are looked up when the diagnostics are printed
+struct Diagnostic
+{
+	uint16_t code;
+	uint32_t length;
+	size_t offset;
+};
+
+struct Diagnostics
+{
+	vector<Diagnostic> records;
+	size_t maxErrors;
+	size_t suppressed;
+};
+
+void report(Diagnostics *diagnostics, DiagnosticCode code, size_t offset, size_t length)
+{
+	if (diagnostics->records.size() >= diagnostics->maxErrors)
+	{
+		diagnostics->suppressed++;
+		return;
+	}
+	diagnostics->records.push_back({(uint16_t)code, (uint32_t)length, offset});
+}
+
+// Appends a DIAG_INVALID_UTF8 record for every malformed sequence in input,
+// in input order. Runs of ASCII are skipped 16 bytes at a time with SSE2 (8
+// at a time elsewhere); only multi-byte sequences are checked one byte at a
+// time.
+void findInvalidUtf8(string_view input, vector<Diagnostic> *invalid)
+{
+	const unsigned char *bytes = (const unsigned char *)input.data();
+	size_t n = input.size();
+	size_t i = 0;
+
+	while (i < n)
+	{
+#ifdef __SSE2__
+		while (i + 16 <= n && _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(bytes + i))) == 0)
+		{
+			i += 16;
+		}
+#endif
+		while (i + 8 <= n)
+		{
+			uint64_t word;
+			memcpy(&word, bytes + i, 8);
+			if (word & 0x8080808080808080ULL)
+				break;
+			i += 8;
+		}
+		if (i >= n)
+			break;
+
+		int bad;
+		int length = sequenceLength(bytes, n, i, &bad);
+		if (length == 0)
+		{
+			invalid->push_back({DIAG_INVALID_UTF8, (uint32_t)bad, i});
+			length = bad;
+		}
+		i += length;
+	}
+}
+
+/*============================ ANALYSIS =====================================================================*/
+
+// The state of one analysis of one input: the file it came from, the
+// limits it runs under, what went wrong and where its lines start. The only
+// thing analyses share is the keyword tables, which are never written, so
+// analyses with contexts of their own can run on separate threads. Each
+// context starts on its own cache line, so neighbouring ones in an array
+// are not written through the same line.
+struct alignas(64) Analysis
+{
+	string fileName;
+	string outputFileName;
+	Limits limits;
+	Diagnostics diagnostics;
+	LineIndex lines;
+};
+
+const Analysis defaultAnalysis = {"", "output_symbol_table.wika", {0, 0, 31, 0, 1000, 0, chrono::steady_clock::time_point::max()}, {{}, 100, 0}, {{}, {}, false}};
+
+// A new analysis of fileName under the limits and error cap of settings
+Analysis analysisOf(const Analysis *settings, const string &fileName, const string &outputFileName)
+{
+	return {fileName, outputFileName, settings->limits, {{}, settings->diagnostics.maxErrors, 0}, {{}, {}, false}};
+}
+
+void printDiagnostics(Analysis *analysis, string_view input, ostream &stream, FILE *file)
+{
+	const string &name = analysis->fileName;
+	const Diagnostics &diagnostics = analysis->diagnostics;
+#ifdef _WIN32
+	bool color = _isatty(_fileno(file));
+#else
+	bool color = isatty(fileno(file));
+#endif
+	string out;
+	for (const Diagnostic &diagnostic : diagnostics.records)
+	{
+		if (color)
+			out += "\u001b[38;5;208m";
+		out += name + ": error: " + diagnosticMessages[diagnostic.code];
+		if (diagnostic.code == DIAG_UNRECOGNIZED_TOKEN || diagnostic.code == DIAG_NUMBER_OUT_OF_RANGE)
+			out += " '" + string(input.substr(diagnostic.offset, diagnostic.length)) + "'";
+		else if (diagnostic.code == DIAG_IDENTIFIER_TOO_LONG)
+			out += " '" + string(input.substr(diagnostic.offset, min<size_t>(diagnostic.length, 40))) + (diagnostic.length > 40 ? "...'" : "'");
+		out += limitOf(&analysis->limits, diagnostic.code);
+		if (diagnostic.code != DIAG_INPUT_TOO_LARGE)
+			out += " on line " + to_string(lineAt(&analysis->lines, diagnostic.offset)) + " column " + to_string(columnAt(&analysis->lines, diagnostic.offset));
+		if (color)
+			out += "\033[0m";
+		out += '\n';
+	}
+	if (diagnostics.suppressed > 0)
+		out += name + ": " + to_string(diagnostics.suppressed) + " more errors not shown\n";
+	stream << out << flush;
+}
+
+/*============================ LEXER ========================================================================*/
+
+enum TokenType
+{
+	DATA_TYPE,
+	KEYWORD,
+	RESERVED_WORD,
+	IDENTIFIER,
+	CONSTANT,
+	ASSIGN_OP,
+	ARITH_OP,
+	REL_OP,
+	LOG_OP,
+	COMMENT,
+	DELIMITER,
+	SEMICOLON,
+	NEWLINE
+};
+
+struct Token
+{
+	TokenType type;
+	string value;
+	string description;
+	size_t offset; // of the token's first byte; lineOf() gives its line
+	// decoded once by the lexer for an Integer or Float Constant Value
+	union
+	{
+		long long integer = 0;
+		double real;
+	};
+	bool inRange = true;
+};
+
+int lineOf(Analysis *analysis, const Token &token)
+{
+	return lineAt(&analysis->lines, token.offset);
+}
+
+const unordered_map<string, Token> tokenTypeMap = {
+	// Data Type
+	{"karakter", {DATA_TYPE, "karakter", "Character Data Type", 0}},
+	{"buumbilang", {DATA_TYPE, "buumbilang", "Integer Data Type", 0}},
+	{"bahagimbilang", {DATA_TYPE, "bahagimbilang", "Floating Point Data Type", 0}},
+	{"bool", {DATA_TYPE, "bool", "Character Data Type", 0}},
+	{"string", {DATA_TYPE, "string", "String Data Type", 0}},
+
+	// Keyword
+	{"kunin", {KEYWORD, "kunin", "Input Statement", 0}},
+	{"tignan", {KEYWORD, "tignan", "Output Statement", 0}},
+
+	// Reserved Word
+	{"kung", {RESERVED_WORD, "kung", "Conditional Statement", 0}},
+	{"kundi_kung", {RESERVED_WORD, "kundi_kung", "Conditional Statement", 0}},
+	{"kundi", {RESERVED_WORD, "kundi", "Conditional Statement", 0}},
+	{"hanggang", {KEYWORD, "hanggang", "Repetition Statement", 0}},
+	{"habang", {KEYWORD, "habang", "Repetition Statement", 0}},
+	{"gawin", {RESERVED_WORD, "gawin", "Repetition Statement", 0}},
+
+	// Logical Operator
+	{"hindi", {LOG_OP, "hindi", "Logical Operator", 0}},
+	{"at", {LOG_OP, "at", "Logical Operator", 0}},
+	{"o_kaya", {LOG_OP, "o_kaya", "Logical Operator", 0}},
+
+	// Constant
+
+	{"tama", {CONSTANT, "tama", "Boolean Constant Value", 0}},
+	{"mali", {CONSTANT, "mali", "Boolean Constant Value", 0}},
+
+};
+
+// The words above plus true and false, which parser.cpp also accepts
+const unordered_map<string, Token> englishBooleanTokenTypeMap = [] {
+	unordered_map<string, Token> words = tokenTypeMap;
+	words.insert({"true", {CONSTANT, "true", "Boolean Constant Value", 0}});
+	words.insert({"false", {CONSTANT, "false", "Boolean Constant Value", 0}});
+	return words;
+}();
+
+// input[i], or '\0' past the end, which a mapped file does not have
+char charAt(string_view input, size_t i)
+{
+	return i < input.size() ? input[i] : '\0';
+}
+
+bool isDigitAt(string_view input, size_t i)
+{
+	return isdigit((unsigned char)charAt(input, i));
+}
+
+// Scans the number rule of reg-ex-final.txt, digits [. digits] [(E|e) [+|-] digits],
+// starting at input[start] and decodes it into token; its value and
+// description are only filled in when text is true. An 'e' that is not
+// followed by digits is left for the next token. Returns the index one
+// past the constant.
+size_t lexNumber(string_view input, size_t start, Token *token, bool text)
+{
+	size_t i = start;
+	bool isFloat = false;
+	while (isDigitAt(input, i))
+		i++;
+	if (charAt(input, i) == '.')
+	{
+		isFloat = true;
+		i++;
+		while (isDigitAt(input, i))
+			i++;
+	}
+	if (charAt(input, i) == 'e' || charAt(input, i) == 'E')
+	{
+		size_t digitsAt = i + 1;
+		if (charAt(input, digitsAt) == '+' || charAt(input, digitsAt) == '-')
+			digitsAt++;
+		if (isDigitAt(input, digitsAt))
+		{
+			isFloat = true;
+			i = digitsAt;
+			while (isDigitAt(input, i))
+				i++;
+		}
+	}
+
+	const char *first = input.data() + start;
+	const char *last = input.data() + i;
+	if (text)
+	{
+		token->value.assign(first, last);
+		token->description = isFloat ? "Float Constant Value" : "Integer Constant Value";
+	}
+	if (isFloat)
+	{
+		token->real = 0;
+		from_chars_result result = from_chars(first, last, token->real);
+		token->inRange = result.ec == errc();
+	}
+	else
+	{
+		from_chars_result result = from_chars(first, last, token->integer);
+		token->inRange = result.ec == errc();
+	}
+	return i;
+}
+
+// The lexer is configured at compile time by a policy, a struct with
+//   newlines   true to emit a NEWLINE token for every line break
+//   comments   true to emit the tokens of // and /* */ comments
+//   quotes     true to emit the " around a string; its CONSTANT is always kept
+//   positions  true to record the byte offset of each token, otherwise 0
+//   strings    true to build each Token with its value and description;
+//              false to pass out only its type and span of the source
+//   keywords() the table of reserved words, such as tokenTypeMap
+// Each policy gets its own copy of the loop below with these checks folded
+// away. Tokens that are left out are never built, and the offsets of the
+// remaining ones are unchanged.
+//
+// Without strings nothing is allocated per token. A comment is then one
+// span from // or /* to its end, and a string CONSTANT without its quotes
+// spans them too, so every span is the token as it is written.
+//
+// Appends the tokens of input to out, which can be any container with
+// push_back, such as a vector<Token>, or with push_span(type, offset,
+// length) for a policy without strings
+template <class Policy, class Tokens>
+void addToken(Tokens &tokens, TokenType type, string_view value, const char *description, size_t at, size_t length)
+{
+	if constexpr (Policy::strings)
+		tokens.push_back({type, string(value), description, at});
+	else
+		tokens.push_span(type, at, length);
+}
+
+template <class Policy, class Tokens>
+void tokenizeInto(Analysis *analysis, string_view input, Tokens *out)
+{
+	Tokens &tokens = *out;
+	const unordered_map<string, Token> &keywords = Policy::keywords();
+	const Limits &limits = analysis->limits;
+	Diagnostics *diagnostics = &analysis->diagnostics;
+	indexLines(&analysis->lines, input);
+	string tokenValue;
+	string tokenDescription;
+	int length;
+
+	if (limits.maxBytes > 0 && input.size() > limits.maxBytes)
+	{
+		report(diagnostics, DIAG_INPUT_TOO_LARGE, 0, 0);
+		return;
+	}
+
+	// malformed UTF-8 is found up front and reported as the lexer passes
+	// it; a bad sequence between tokens is skipped, one inside a comment or
+	// string stays part of it
+	vector<Diagnostic> invalid;
+	findInvalidUtf8(input, &invalid);
+	size_t nextInvalid = 0;
+
+	// the token count is checked before each token, the clock every 4 KB of input
+	size_t first = tokens.size();
+	size_t maxTokens = limits.maxTokens > 0 ? limits.maxTokens : SIZE_MAX;
+	size_t maxDepth = limits.maxDepth > 0 ? limits.maxDepth : SIZE_MAX;
+	size_t depth = 0;
+	size_t nextClockCheck = 0;
+
+	for (size_t i = 0; i < input.size(); i++)
+	{
+		ALLOCATION_SITE("lexer: operators and delimiters");
+		while (nextInvalid < invalid.size() && invalid[nextInvalid].offset < i)
+		{
+			report(diagnostics, DIAG_INVALID_UTF8, invalid[nextInvalid].offset, invalid[nextInvalid].length);
+			nextInvalid++;
+		}
+		if (nextInvalid < invalid.size() && invalid[nextInvalid].offset == i)
+		{
+			report(diagnostics, DIAG_INVALID_UTF8, i, invalid[nextInvalid].length);
+			i += invalid[nextInvalid++].length - 1;
+			continue;
+		}
+		char c = input[i];
+		size_t at = Policy::positions ? i : 0; // where the token starts
+
+		if (i >= nextClockCheck)
+		{
+			nextClockCheck = i + 4096;
+			if (pastDeadline(&limits))
+			{
+				report(diagnostics, DIAG_TIME_LIMIT, i, 1);
+				return;
+			}
+		}
+
+		if (c == '\n')
+		{
+			if (Policy::newlines)
+				addToken<Policy>(tokens, NEWLINE, input.substr(i, 1), "New Line Character", at, 1);
+		}
+		if (isspace((unsigned char)c))
+			continue;
+		if (tokens.size() - first >= maxTokens)
+		{
+			report(diagnostics, DIAG_TOO_MANY_TOKENS, i, 1);
+			return;
+		}
+		switch (c)
+		{
+		case '+':
+			addToken<Policy>(tokens, ARITH_OP, input.substr(i, 1), "Addition Symbol", at, 1);
+			break;
+		case '-':
+			addToken<Policy>(tokens, ARITH_OP, input.substr(i, 1), "Subraction Symbol", at, 1);
+			break;
+		case '*':
+			addToken<Policy>(tokens, ARITH_OP, input.substr(i, 1), "Multiplication Symbol", at, 1);
+			break;
+		case '%':
+			addToken<Policy>(tokens, ARITH_OP, input.substr(i, 1), "Modulus Symbol", at, 1);
+			break;
+		case '/':
+			if (charAt(input, i + 1) == '/')
+			{
+				// single line comment
+				ALLOCATION_SITE("lexer: comments");
+				size_t end = input.find('\n', i + 2);
+				if (end == string::npos)
+					end = input.size();
+				if (Policy::comments && !Policy::strings)
+					addToken<Policy>(tokens, COMMENT, input.substr(i, end - i), "", at, end - i);
+				else if (Policy::comments)
+				{
+					addToken<Policy>(tokens, COMMENT, "//", "Single Line Comment start", at, 2);
+					addToken<Policy>(tokens, COMMENT, input.substr(i + 2, end - i - 2), "Single line comment", at, end - i - 2);
+				}
+				// leave the newline for the next iteration
+				i = end - 1;
+			}
+			else if (charAt(input, i + 1) == '*')
+			{
+				// multi line comment, which runs to the end of the input when unterminated
+				ALLOCATION_SITE("lexer: comments");
+				size_t start = i;
+				size_t end = input.find("*/", i + 2);
+				bool keep = Policy::comments && Policy::strings;
+				size_t close = end == string::npos ? input.size() : end + 2;
+				if (Policy::comments && !Policy::strings)
+					addToken<Policy>(tokens, COMMENT, input.substr(i, close - i), "", at, close - i);
+				if (keep)
+					addToken<Policy>(tokens, COMMENT, "/*", "Multi Line Comment Start", at, 2);
+				if (end == string::npos)
+				{
+					report(diagnostics, DIAG_UNTERMINATED_COMMENT, start, 2);
+					if (keep)
+						addToken<Policy>(tokens, COMMENT, input.substr(i + 2), "Multi line comment", at, input.size() - i - 2);
+					i = input.size();
+					break;
+				}
+				if (keep)
+				{
+					addToken<Policy>(tokens, COMMENT, input.substr(i + 2, end - i - 2), "Multi line comment", at, end - i - 2);
+					addToken<Policy>(tokens, COMMENT, "*/", "Multi Line Comment End", at, 2);
+				}
+				i = end + 1;
+			}
+			else
+			{
+				// not a comment, treat as an operator
+				addToken<Policy>(tokens, ARITH_OP, input.substr(i, 1), "Division Symbol", at, 1);
+			}
+			break;
+		case '=':
+			if (charAt(input, i + 1) == '=')
+			{
+				addToken<Policy>(tokens, REL_OP, input.substr(i, 2), "Relational Operator", at, 2);
+				i++;
+			}
+			else
+			{
+				addToken<Policy>(tokens, ASSIGN_OP, input.substr(i, 1), "Assignment Operator", at, 1);
+			}
+			break;
+		case '>':
+			if (charAt(input, i + 1) == '=')
+			{
+				addToken<Policy>(tokens, REL_OP, input.substr(i, 2), "Relational Operator", at, 2);
+				i++;
+			}
+			else
+			{
+				addToken<Policy>(tokens, REL_OP, input.substr(i, 1), "Relational Operator", at, 1);
+			}
+			break;
+		case '<':
+			if (charAt(input, i + 1) == '=')
+			{
+				addToken<Policy>(tokens, REL_OP, input.substr(i, 2), "Relational Operator", at, 2);
+				i++;
+			}
+			else
+			{
+				addToken<Policy>(tokens, REL_OP, input.substr(i, 1), "Relational Operator", at, 1);
+			}
+			break;
+		case '!':
+			if (charAt(input, i + 1) == '=')
+			{
+				addToken<Policy>(tokens, REL_OP, input.substr(i, 2), "Relational Operator", at, 2);
+				i++;
+			}
+			else
+			{
+				addToken<Policy>(tokens, LOG_OP, input.substr(i, 1), "Logical Operator", at, 1);
+			}
+			break;
+		case ';':
+			addToken<Policy>(tokens, SEMICOLON, input.substr(i, 1), "Semicolon", at, 1);
+			break;
+		case '\\':
+			addToken<Policy>(tokens, DELIMITER, input.substr(i, 1), "Backslash", at, 1);
+			break;
+		case '(':
+			if (++depth > maxDepth)
+			{
+				report(diagnostics, DIAG_NESTING_TOO_DEEP, i, 1);
+				return;
+			}
+			addToken<Policy>(tokens, DELIMITER, input.substr(i, 1), "Left Parenthesis", at, 1);
+			break;
+		case ')':
+			if (depth > 0)
+				depth--;
+			addToken<Policy>(tokens, DELIMITER, input.substr(i, 1), "Right Parenthesis", at, 1);
+			break;
+		case '[':
+			if (++depth > maxDepth)
+			{
+				report(diagnostics, DIAG_NESTING_TOO_DEEP, i, 1);
+				return;
+			}
+			addToken<Policy>(tokens, DELIMITER, input.substr(i, 1), "Left Bracket", at, 1);
+			break;
+		case ']':
+			if (depth > 0)
+				depth--;
+			addToken<Policy>(tokens, DELIMITER, input.substr(i, 1), "Right Bracket", at, 1);
+			break;
+		case '{':
+			if (++depth > maxDepth)
+			{
+				report(diagnostics, DIAG_NESTING_TOO_DEEP, i, 1);
+				return;
+			}
+			addToken<Policy>(tokens, DELIMITER, input.substr(i, 1), "Left Braces", at, 1);
+			break;
+		case '}':
+			if (depth > 0)
+				depth--;
+			addToken<Policy>(tokens, DELIMITER, input.substr(i, 1), "Right Braces", at, 1);
+			break;
+		case ',':
+			addToken<Policy>(tokens, DELIMITER, input.substr(i, 1), "Comma", at, 1);
+			break;
+		case '.':
+			// a '.' right after digits is part of a float constant, see lexNumber()
+			addToken<Policy>(tokens, DELIMITER, input.substr(i, 1), "Period", at, 1);
+			break;
+		case '"':
+		{
+			ALLOCATION_SITE("lexer: string constants");
+			size_t start = i;
+			size_t end = input.find('"', i + 1);
+			if (end == string::npos)
+			{
+				// end the string at the end of its line and carry on from the next
+				report(diagnostics, DIAG_UNTERMINATED_STRING, start, 1);
+				size_t lineEnd = input.find('\n', start);
+				i = (lineEnd == string::npos ? input.size() : lineEnd) - 1;
+				break;
+			}
+			// a string over the limit is left out rather than copied
+			if (limits.maxString > 0 && end - start - 1 > limits.maxString && countCodePoints(input.substr(start + 1, end - start - 1)) > limits.maxString)
+			{
+				report(diagnostics, DIAG_STRING_TOO_LONG, start, end - start + 1);
+				i = end;
+				break;
+			}
+			if (Policy::quotes)
+				addToken<Policy>(tokens, DELIMITER, "\"", "Delimiter Double Quotation", at, 1);
+			if (Policy::quotes || Policy::strings)
+				addToken<Policy>(tokens, CONSTANT, input.substr(start + 1, end - start - 1), "String Constant Value", at, end - start - 1);
+			else
+				addToken<Policy>(tokens, CONSTANT, input.substr(start, end - start + 1), "String Constant Value", at, end - start + 1);
+			if (Policy::quotes)
+				addToken<Policy>(tokens, DELIMITER, "\"", "Delimiter Double Quotation", at, 1);
+			i = end;
+			break;
+		}
+		default:
+			if (isalpha((unsigned char)c) || c == '_' || ((unsigned char)c >= 0x80 && isUnicodeLetter(decodeUtf8(input, i, &length))))
+			{
+				ALLOCATION_SITE("lexer: identifiers and keywords");
+				size_t start = i;
+				while (i < input.size())
+				{
+					unsigned char b = input[i];
+					if (b < 0x80)
+					{
+						if (!isalnum(b) && b != '_')
+							break;
+						i++;
+					}
+					else
+					{
+						if (nextInvalid < invalid.size() && invalid[nextInvalid].offset == i)
+							break;
+						uint32_t codePoint = decodeUtf8(input, i, &length);
+						if (!isUnicodeLetter(codePoint) && !isUnicodeMark(codePoint))
+							break;
+						i += length;
+					}
+				}
+				// tokenValue keeps its buffer from one identifier to the next
+				tokenValue = input.substr(start, i - start);
+				// bytes bound characters from above, so most identifiers are never counted
+				if (limits.maxIdentifier > 0 && tokenValue.size() > limits.maxIdentifier && countCodePoints(tokenValue) > limits.maxIdentifier)
+					report(diagnostics, DIAG_IDENTIFIER_TOO_LONG, start, i - start);
+				i--;
+				TokenType tokenType = IDENTIFIER;
+
+				auto keyword = keywords.find(tokenValue);
+				if (keyword != keywords.end())
+					tokenType = keyword->second.type;
+				if constexpr (Policy::strings)
+				{
+					if (keyword != keywords.end())
+						tokenDescription = keyword->second.description;
+					else
+						tokenDescription = "Identifier " + tokenValue;
+					tokens.push_back({tokenType, tokenValue, tokenDescription, at});
+				}
+				else
+					tokens.push_span(tokenType, at, tokenValue.size());
+			}
+			else if (isdigit((unsigned char)c))
+			{
+				ALLOCATION_SITE("lexer: numbers");
+				Token number = {CONSTANT, "", "", at};
+				size_t end = lexNumber(input, i, &number, Policy::strings);
+				if (!number.inRange)
+					report(diagnostics, DIAG_NUMBER_OUT_OF_RANGE, i, end - i);
+				if constexpr (Policy::strings)
+					tokens.push_back(number);
+				else
+					tokens.push_span(CONSTANT, at, end - i);
+				i = end - 1;
+			}
+			else
+			{
+				// report a multi-byte character once rather than once per byte
+				decodeUtf8(input, i, &length);
+				report(diagnostics, DIAG_UNRECOGNIZED_TOKEN, i, length);
+				i += length - 1;
+			}
+			break;
+		}
+	}
+	// bad sequences in a comment or string that runs to the end of the input
+	for (; nextInvalid < invalid.size(); nextInvalid++)
+	{
+		report(diagnostics, DIAG_INVALID_UTF8, invalid[nextInvalid].offset, invalid[nextInvalid].length);
+	}
+}
+
+template <class Policy>
+vector<Token> tokenize(Analysis *analysis, string_view input)
+{
+	vector<Token> tokens;
+	tokenizeInto<Policy>(analysis, input, &tokens);
+	return tokens;
+}
+
+#endif
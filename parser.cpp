@@ -21,31 +21,87 @@ Members:
 #include <iostream>
 #include <unordered_map>
 #include <string>
+#include <string_view>
+#include <deque>
 #include <vector>
 #include <fstream>
+#include <memory>
+#include <chrono>
+#include <charconv>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <fcntl.h>
+#include <filesystem>
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#include "lexer.hpp"
+#include "token_table.hpp"
 
 using namespace std;
 
-string fileName = "clarence.wika";
-string outputFileName = "output_symbol_table.wika";
+// --no-optimize and --time-passes, for programs run or translated to C. Set
+// by main() before any analysis starts and only read after that; the state
+// of an analysis lives in its Analysis (see lexer.hpp).
+bool optimize = true;
+bool timePasses = false;
 
 /*============================= LEXER ========================================================================*/
 
-enum TokenType
+// Every token, for the symbol table and the statement report
+struct ReportLexer
 {
-	DATA_TYPE,
-	KEYWORD,
-	RESERVED_WORD,
-	IDENTIFIER,
-	CONSTANT,
-	ASSIGN_OP,
-	ARITH_OP,
-	REL_OP,
-	LOG_OP,
-	COMMENT,
-	DELIMITER,
-	SEMICOLON,
-	NEWLINE
+	static constexpr bool newlines = true;
+	static constexpr bool comments = true;
+	static constexpr bool quotes = true;
+	static constexpr bool positions = true;
+	static constexpr bool strings = true;
+	static const unordered_map<string, Token> &keywords() { return englishBooleanTokenTypeMap; }
+};
+
+// --syntax-only: parse() ends statements at newlines but never uses comments
+struct SyntaxLexer : ReportLexer
+{
+	static constexpr bool comments = false;
+};
+
+// --fmt: only the type and source span of each token, with a comment or a
+// string and its quotes as one span
+struct FormatLexer : ReportLexer
+{
+	static constexpr bool quotes = false;
+	static constexpr bool strings = false;
+};
+
+// --run, --bench and the C backend: the program parser ignores newlines
+// and reads a string CONSTANT without its quotes
+struct ProgramLexer : SyntaxLexer
+{
+	static constexpr bool newlines = false;
+	static constexpr bool quotes = false;
 };
 
 string stringify(TokenType token)
@@ -79,382 +135,305 @@ string stringify(TokenType token)
 	}
 }
 
-struct Token
-{
-	TokenType type;
-	string value;
-	string description;
-	int line;
-};
-
-unordered_map<string, Token> tokenTypeMap = {
-	// Data Type
-	{"karakter", {DATA_TYPE, "karakter", "Character Data Type", 0}},
-	{"buumbilang", {DATA_TYPE, "buumbilang", "Integer Data Type", 0}},
-	{"bahagimbilang", {DATA_TYPE, "bahagimbilang", "Floating Point Data Type", 0}},
-	{"bool", {DATA_TYPE, "bool", "Character Data Type", 0}},
-	{"string", {DATA_TYPE, "string", "String Data Type", 0}},
+/*============================ TOKEN STORE ==================================================================*/
 
-	// Keyword
-	{"kunin", {KEYWORD, "kunin", "Input Statement", 0}},
-	{"tignan", {KEYWORD, "tignan", "Output Statement", 0}},
+// Token stream for --max-memory. Tokens are kept in segments of a fixed
+// number of tokens. When the resident segments go over the budget the one
+// furthest behind the reader is written to a temporary file and freed; it is
+// mapped back and decoded the next time one of its tokens is read. Only the
+// last segment is ever appended to, so a segment that was spilled once is
+// still valid on disk and is simply dropped the next time.
+const size_t segmentTokens = 1 << 12;
 
-	// Reserved Word
-	{"kung", {RESERVED_WORD, "kung", "Conditional Statement", 0}},
-	{"kundi_kung", {RESERVED_WORD, "kundi_kung", "Conditional Statement", 0}},
-	{"kundi", {RESERVED_WORD, "kundi", "Conditional Statement", 0}},
-	{"hanggang", {KEYWORD, "hanggang", "Repetition Statement", 0}},
-	{"habang", {KEYWORD, "habang", "Repetition Statement", 0}},
+struct Segment
+{
+	vector<Token> tokens;
+	bool resident;
+	bool spilled;
+	size_t offset; // position of the encoded tokens in the spill file
+	size_t bytes;
+	size_t memory; // estimated heap use while resident
+};
 
-	// Logical Operator
-	{"hindi", {LOG_OP, "hindi", "Logical Operator", 0}},
-	{"at", {LOG_OP, "at", "Logical Operator", 0}},
-	{"o_kaya", {LOG_OP, "o_kaya", "Logical Operator", 0}},
+size_t tokenMemory(const Token &token)
+{
+	// strings past the small string buffer own a heap block
+	size_t memory = sizeof(Token);
+	if (token.value.capacity() > 15)
+		memory += token.value.capacity() + 1;
+	if (token.description.capacity() > 15)
+		memory += token.description.capacity() + 1;
+	return memory;
+}
 
-	// Constant
+struct TokenStore
+{
+	vector<Segment> segments;
+	size_t count = 0;
+	size_t budget;
+	size_t resident = 0;
+	FILE *spill = nullptr;
+	size_t spillSize = 0;
+	size_t spills = 0;
+	size_t reloads = 0;
 
-	{"tama", {CONSTANT, "tama", "Boolean Constant Value", 0}},
-	{"mali", {CONSTANT, "mali", "Boolean Constant Value", 0}},
-	{"true", {CONSTANT, "true", "Boolean Constant Value", 0}},
-	{"false", {CONSTANT, "false", "Boolean Constant Value", 0}},
+	TokenStore(size_t budget) : budget(budget) {}
+	~TokenStore()
+	{
+		if (spill != nullptr)
+			fclose(spill);
+	}
 
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	void push_back(const Token &token);
+	void pop_back();
+	Token operator[](size_t index);
+	const vector<Token> &segment(size_t s);
 };
 
-vector<string> errors;
-
-void unrecognizedToken(string token, int index)
+void encodeToken(string *out, const Token &token)
 {
-	cout << "unrecognized token " << token << " on input string index " << index << endl;
+	uint32_t fields[3] = {(uint32_t)token.type, (uint32_t)token.value.size(), (uint32_t)token.description.size()};
+	out->append((const char *)fields, sizeof(fields));
+	out->append((const char *)&token.offset, sizeof(token.offset));
+	out->append((const char *)&token.integer, sizeof(token.integer));
+	out->push_back(token.inRange);
+	out->append(token.value);
+	out->append(token.description);
 }
 
-vector<Token> tokenize(string input)
+const char *decodeToken(const char *in, Token *token)
 {
-	vector<Token> tokens;
-	string tokenValue;
-	string tokenDescription;
-	int tokenLine;
+	uint32_t fields[3];
+	memcpy(fields, in, sizeof(fields));
+	in += sizeof(fields);
+	token->type = (TokenType)fields[0];
+	memcpy(&token->offset, in, sizeof(token->offset));
+	in += sizeof(token->offset);
+	memcpy(&token->integer, in, sizeof(token->integer));
+	token->inRange = in[sizeof(token->integer)];
+	in += sizeof(token->integer) + 1;
+	token->value.assign(in, fields[1]);
+	in += fields[1];
+	token->description.assign(in, fields[2]);
+	return in + fields[2];
+}
 
-	int line = 1;
-	int col = 1;
-	int lineStart;
+bool spillSegment(TokenStore *store, Segment *segment)
+{
+	if (store->spill == nullptr && (store->spill = tmpfile()) == nullptr)
+		return false;
+	string encoded;
+	for (const Token &token : segment->tokens)
+	{
+		encodeToken(&encoded, token);
+	}
+	if (fseek(store->spill, store->spillSize, SEEK_SET) != 0 || fwrite(encoded.data(), 1, encoded.size(), store->spill) != encoded.size() || fflush(store->spill) != 0)
+		return false;
+	segment->offset = store->spillSize;
+	segment->bytes = encoded.size();
+	segment->spilled = true;
+	store->spillSize += encoded.size();
+	store->spills++;
+	return true;
+}
 
-	for (int i = 0; i < input.size(); i++)
+bool loadSegment(TokenStore *store, Segment *segment)
+{
+	segment->tokens.resize(segmentTokens);
+#ifdef _WIN32
+	string encoded(segment->bytes, '\0');
+	if (_fseeki64(store->spill, segment->offset, SEEK_SET) != 0 || fread(&encoded[0], 1, encoded.size(), store->spill) != encoded.size())
+		return false;
+	const char *in = encoded.data();
+#else
+	// mmap needs a page-aligned offset
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t skip = segment->offset % page;
+	void *map = mmap(nullptr, segment->bytes + skip, PROT_READ, MAP_PRIVATE, fileno(store->spill), segment->offset - skip);
+	if (map == MAP_FAILED)
+		return false;
+	const char *in = (const char *)map + skip;
+#endif
+	for (Token &token : segment->tokens)
 	{
-		char c = input[i];
+		in = decodeToken(in, &token);
+	}
+#ifndef _WIN32
+	munmap(map, segment->bytes + skip);
+#endif
+	store->reloads++;
+	return true;
+}
 
-		if (c == '\n')
+// Spills segments until the resident ones fit the budget again. Every pass
+// reads the tokens front to back, so the segment furthest behind keep goes
+// first, then the one furthest ahead of it. Least recently used would spill
+// exactly the segment the next pass starts with. The parser looks back to
+// the start of the statement it is reading, so keep and the segment before
+// it stay resident whatever the budget, as does the last segment.
+void evictSegments(TokenStore *store, size_t keep)
+{
+	while (store->resident > store->budget)
+	{
+		size_t victim = SIZE_MAX;
+		for (size_t s = 0; s + 1 < store->segments.size(); s++)
 		{
-			tokens.push_back({NEWLINE, "\n", "New Line Character", line});
-			line++;
-			col = 1;
+			if (!store->segments[s].resident || s == keep || s + 1 == keep)
+				continue;
+			victim = s;
+			if (s < keep)
+				break;
 		}
-		else
+		if (victim == SIZE_MAX)
+			return;
+		Segment *segment = &store->segments[victim];
+		if (!segment->spilled && !spillSegment(store, segment))
 		{
-			col++;
+			cout << "Error: could not write the token spill file" << endl;
+			exit(1);
 		}
-		if (isspace(c))
-			continue;
-		switch (c)
-		{
-		case '+':
-			tokens.push_back({ARITH_OP, string(1, c), "Addition Symbol", line});
-			break;
-		case '-':
-			tokens.push_back({ARITH_OP, string(1, c), "Subraction Symbol, line", line});
-			break;
-		case '*':
-			tokens.push_back({ARITH_OP, string(1, c), "Multiplication Symbol, line", line});
-			break;
-		case '%':
-			tokens.push_back({ARITH_OP, string(1, c), "Modulus Symbol, line", line});
-			break;
-		case '/':
-			if (input[i + 1] == '/')
-			{
-				// single line comment
-				i += 2;
-				tokenValue = "";
-				while (input[i] != '\n' && input[i] != EOF)
-				{
-					tokenValue += input[i];
-					i++;
-				}
-				tokens.push_back({COMMENT, "//", "Single Line Comment start", line});
-				tokens.push_back({COMMENT, tokenValue, "Single line comment", line});
-			}
-			else if (input[i + 1] == '*')
-			{
-				// single line comment
-				i += 2;
-				tokenValue = "";
-				while (input[i] != '*' && input[i] != '/' && input[i] != EOF)
-				{
-					tokenValue += input[i];
-					i++;
-				}
-				if (input[i] != '*' && input[i] + 1 != '/')
-				{
-					// print the error message
-					errors.push_back("\u001b[38;5;208m" + fileName + ": error: missing terminating */" + " on line " + to_string(line) + " column " + to_string(col) + "\033[0m\n\t");
-
-					// return the tokens
-					return tokens;
-				}
-				tokens.push_back({COMMENT, "/*", "Multi Line Comment Start", line});
-				tokens.push_back({COMMENT, tokenValue, "Multi line comment", line});
-				tokens.push_back({COMMENT, "*/", "Multi Line Comment End", line});
-			}
-			else
-			{
-				// not a comment, treat as an operator
-				tokenValue = input[i];
-				tokens.push_back({ARITH_OP, tokenValue, "Division Symbol", line});
-			}
-			break;
-		case '=':
-			if (input[i + 1] == '=')
-			{
-				tokens.push_back({REL_OP, "==", "Relational Operator", line});
-				i++;
-			}
-			else
-			{
-				tokens.push_back({ASSIGN_OP, string(1, c), "Assignment Operator", line});
-			}
-			break;
-		case '>':
-			if (input[i + 1] == '=')
-			{
-				tokens.push_back({REL_OP, ">=", "Relational Operator", line});
-				i++;
-			}
-			else
-			{
-				tokens.push_back({REL_OP, string(1, c), "Relational Operator", line});
-			}
-			break;
-		case '<':
-			if (input[i + 1] == '=')
-			{
-				tokens.push_back({REL_OP, "<=", "Relational Operator", line});
-				i++;
-			}
-			else
-			{
-				tokens.push_back({REL_OP, string(1, c), "Relational Operator", line});
-			}
-			break;
-		case '!':
-			if (input[i + 1] == '=')
-			{
-				tokens.push_back({REL_OP, "!=", "Relational Operator", line});
-				i++;
-			}
-			else
-			{
-				tokens.push_back({LOG_OP, string(1, c), "Logical Operator", line});
-			}
-			break;
-		case ';':
-			tokens.push_back({SEMICOLON, string(1, c), "Semicolon", line});
-			break;
-		case '\\':
-			tokens.push_back({DELIMITER, string(1, c), "Backslash", line});
-			break;
-		case '(':
-			tokens.push_back({DELIMITER, string(1, c), "Left Parenthesis", line});
-			break;
-		case ')':
-			tokens.push_back({DELIMITER, string(1, c), "Right Parenthesis", line});
-			break;
-		case '[':
-			tokens.push_back({DELIMITER, string(1, c), "Left Bracket", line});
-			break;
-		case ']':
-			tokens.push_back({DELIMITER, string(1, c), "Right Bracket", line});
-			break;
-		case '{':
-			tokens.push_back({DELIMITER, string(1, c), "Left Braces", line});
-			break;
-		case '}':
-			tokens.push_back({DELIMITER, string(1, c), "Right Braces", line});
-			break;
-		case ',':
-			tokens.push_back({DELIMITER, string(1, c), "Comma", line});
-			break;
-		case '.':
-			// Check if the character before the '.' is a digit
-			if (isdigit(input[i - 1]))
-			{
-				// If the character before the '.' is a digit, we have a float constant
-				// Concatenate the integer and float parts together into a single token value
-				tokenValue += input[i];
-				// Consume the remaining float digits
-				while (isdigit(input[i + 1]))
-				{
-					tokenValue += input[i + 1];
-					i++;
-				}
-				// Add the float constant token to the list of tokens
-				tokens.pop_back();
-				tokens.push_back({CONSTANT, tokenValue, "Float Constant Value", line});
-				break;
-			}
-			else
-			{
-				// If the character before the '.' is not a digit, we have a single '.' token
-				// Add the '.' token to the list of tokens
+		vector<Token>().swap(segment->tokens);
+		segment->resident = false;
+		store->resident -= segment->memory;
+	}
+}
 
-				tokens.push_back({DELIMITER, ".", "Period", line});
-				break;
-			}
-			break;
-		case '"':
-			tokenValue = "";
-			i++;
-			while (input[i] != '"' && input[i] != EOF)
-			{
-				tokenValue += input[i];
-				i++;
-			}
-			if (input[i] != '"')
-			{
-				// print the error message
-				errors.push_back("\u001b[38;5;208m" + fileName + ": error: missing terminating \" character" + " on line " + to_string(line) + " column " + to_string(col) + "\033[0m\n\t");
+void TokenStore::push_back(const Token &token)
+{
+	if (segments.empty() || segments.back().tokens.size() == segmentTokens)
+	{
+		segments.push_back({{}, true, false, 0, 0, 0});
+		segments.back().tokens.reserve(segmentTokens);
+		segments.back().memory = segmentTokens * sizeof(Token);
+		resident += segments.back().memory;
+	}
+	Segment &last = segments.back();
+	last.tokens.push_back(token);
+	size_t memory = tokenMemory(last.tokens.back()) - sizeof(Token);
+	last.memory += memory;
+	resident += memory;
+	count++;
+	if (resident > budget)
+		evictSegments(this, SIZE_MAX);
+}
 
-				// return the tokens
-				return tokens;
-			}
-			tokens.push_back({DELIMITER, "\"", "Delimiter Double Quotation", line});
-			tokens.push_back({CONSTANT, tokenValue, "String Constant Value", line});
-			tokens.push_back({DELIMITER, "\"", "Delimiter Double Quotation", line});
-			break;
-		default:
-			if (isalpha(c) || c == '_')
-			{
-				tokenValue = "";
-				while (isalpha(input[i]) || (input[i]) == '_' || isdigit(input[i]))
-				{
-					tokenValue += input[i];
-					i++;
-				}
-				i--;
-				TokenType tokenType = IDENTIFIER;
+// The lexer only takes back the token it just pushed, which is in the last segment
+void TokenStore::pop_back()
+{
+	Segment &last = segments.back();
+	size_t memory = tokenMemory(last.tokens.back()) - sizeof(Token);
+	last.memory -= memory;
+	resident -= memory;
+	last.tokens.pop_back();
+	count--;
+}
 
-				if (tokenTypeMap.count(tokenValue) > 0)
-				{
-					tokenType = tokenTypeMap[tokenValue].type;
-					tokenDescription = tokenTypeMap[tokenValue].description;
-					tokenLine = line;
-				}
-				else
-				{
-					tokenDescription = "Identifier " + tokenValue;
-				}
-				tokens.push_back({tokenType, tokenValue, tokenDescription, line});
-			}
-			else if (isdigit(c))
-			{
-				tokenValue = "";
-				while (isdigit(input[i]))
-				{
-					tokenValue += input[i];
-					i++;
-				}
-				i--;
-				tokens.push_back({CONSTANT, tokenValue, "Integer Constant Value", line});
-			}
-			else
-			{
-				cout << "unrecognized token '" << string(1, c) << "' on line " << line << " column " << col - 1 << endl;
-			}
-			break;
+const vector<Token> &TokenStore::segment(size_t s)
+{
+	Segment *segment = &segments[s];
+	if (!segment->resident)
+	{
+		if (!loadSegment(this, segment))
+		{
+			cout << "Error: could not read the token spill file" << endl;
+			exit(1);
 		}
+		segment->resident = true;
+		resident += segment->memory;
+		evictSegments(this, s);
 	}
-	return tokens;
+	return segment->tokens;
 }
 
-void printTokens(vector<Token> tokens)
+// Returned by value: the segment holding the token may be spilled by the next read
+Token TokenStore::operator[](size_t index)
 {
-	ofstream file(outputFileName);
-	if (file.is_open())
-	{
+	return segment(index / segmentTokens)[index % segmentTokens];
+}
 
-		file << endl
-			 << "LINE\t\t\t"
-			 << "INDEX\t\t\t"
-			 << "TOKEN\t\t\t\t"
-			 << "TYPE\t\t\t"
-			 << "DESCRIPTION\t\t"
-			 << endl;
-		for (int i = 0; i < tokens.size(); i++)
-		{
-			file << tokens[i].line
-				 << "\t\t\t"; // INDEXF
-			file << i
-				 << "\t\t\t"; // INDEXF
-			file
-				<< tokens[i].value
-				<< "\t\t\t\t"; // TOKEN
-			switch (tokens[i].type)
-			{ // TOKEN TYPE
-			case DATA_TYPE:
-				file << "DATA_TYPE"
-					 << "\t\t\t";
-				break;
-			case KEYWORD:
-				file << "KEYWORD"
-					 << "\t\t\t";
-				break;
-			case RESERVED_WORD:
-				file << "RESERVED_WORD"
-					 << "\t\t";
-				break;
-			case IDENTIFIER:
-				file << "IDENTIFIER"
-					 << "\t\t";
-				break;
-			case CONSTANT:
-				file << "CONSTANT"
-					 << "\t\t";
-				break;
-			case ASSIGN_OP:
-				file << "ASSIGN_OP"
-					 << "\t\t\t";
-				break;
-			case ARITH_OP:
-				file << "ARITH_OP"
-					 << "\t\t\t\t";
-				break;
-			case REL_OP:
-				file << "REL_OP"
-					 << "\t\t\t";
-				break;
-			case LOG_OP:
-				file << "LOG_OP"
-					 << "\t\t\t";
-				break;
-			case SEMICOLON:
-				file << "SEMICOLON"
-					 << "\t\t\t\t";
-				break;
-			case COMMENT:
-				file << "COMMENT"
-					 << "\t\t\t\t";
-				break;
-			case DELIMITER:
-				file << "DELIMITER"
-					 << "\t\t\t\t";
-				break;
+Token tokenAt(TokenStore *tokens, int j)
+{
+	if ((size_t)j < (*tokens).size())
+		return (*tokens)[j];
+	return {NEWLINE, "\n", "End of Input", 0};
+}
+
+// Same table as printTokens(), formatted on one thread so only a segment
+// or two of tokens is resident at a time
+void printTokens(Analysis *analysis, TokenStore *store)
+{
+	const string &outputFileName = analysis->outputFileName;
+	FILE *file = fopen(outputFileName.c_str(), "wb");
+	if (file != nullptr)
+	{
+		string buffer = lineSymbolTableHeader;
+		bool ok = true;
+		lineAt(&analysis->lines, 0);
+		size_t index = 0;
+		size_t line = 1;
+		for (size_t s = 0; s < store->segments.size(); s++)
+		{
+			for (const Token &token : store->segment(s))
+			{
+				line = advanceLine(&analysis->lines, line, token.offset);
+				appendTokenRow(&buffer, token, index++, line);
 			}
-			file << "" << tokens[i].description << endl; // TOKEN DESCRIPTION
+			if (buffer.size() >= (1 << 16))
+			{
+				ok = ok && fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+				buffer.clear();
+			}
+		}
+		ok = ok && fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+		if (fclose(file) != 0 || !ok)
+		{
+			cout << "Error: could not write " << outputFileName << endl;
 		}
 	}
 	cout << ">> Generating output symbol table..." << endl
 		 << endl;
 	cout << ">> Output file generated: " << outputFileName << endl
 		 << endl;
-	file.close();
+}
+
+// Accepts a byte count with an optional K, M or G suffix
+bool parseMemorySize(const string &text, size_t *bytes)
+{
+	char *end;
+	errno = 0;
+	unsigned long long value = strtoull(text.c_str(), &end, 10);
+	if (end == text.c_str() || errno != 0)
+		return false;
+	string suffix = end;
+	if (suffix == "K" || suffix == "k")
+		value <<= 10;
+	else if (suffix == "M" || suffix == "m")
+		value <<= 20;
+	else if (suffix == "G" || suffix == "g")
+		value <<= 30;
+	else if (!suffix.empty())
+		return false;
+	*bytes = value;
+	return true;
+}
+
+// Peak resident set size of the process in kilobytes, 0 where unknown
+long long peakResidentKilobytes()
+{
+#ifdef _WIN32
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+#endif
 }
 
 /*============================ PARSER =======================================================================*/
@@ -465,21 +444,87 @@ struct Statement
 	string syntax;
 	bool validity;
 	string message;
+	int start; // index of the statement's first token
+	int end;   // one past its last token
 };
 
+enum ValueType
+{
+	TYPE_KARAKTER,
+	TYPE_BUUMBILANG,
+	TYPE_BAHAGIMBILANG,
+	TYPE_BOOL,
+	TYPE_STRING
+};
+
+string stringify(ValueType type)
+{
+	switch (type)
+	{
+	case TYPE_KARAKTER:
+		return "karakter";
+	case TYPE_BUUMBILANG:
+		return "buumbilang";
+	case TYPE_BAHAGIMBILANG:
+		return "bahagimbilang";
+	case TYPE_BOOL:
+		return "bool";
+	default:
+		return "string";
+	}
+}
+
+ValueType valueTypeOf(const string &dataType)
+{
+	if (dataType == "karakter")
+		return TYPE_KARAKTER;
+	if (dataType == "buumbilang")
+		return TYPE_BUUMBILANG;
+	if (dataType == "bahagimbilang")
+		return TYPE_BAHAGIMBILANG;
+	if (dataType == "bool")
+		return TYPE_BOOL;
+	return TYPE_STRING;
+}
+
+// Whether a value of type value may be stored in a target variable. The
+// numeric types, bool and karakter convert into one another; a string only
+// goes into a string. The semantic pass and both program backends use this
+// one rule, so they accept the same declarations and assignments.
+bool assignable(ValueType target, ValueType value)
+{
+	return target == value || (target != TYPE_STRING && value != TYPE_STRING);
+}
+
 string but_got(Token token)
 {
+	ALLOCATION_SITE("parser: but_got()");
+	// a line break would split the report row, and past the last token there is nothing to quote
+	if (token.type == NEWLINE)
+		return "but got end of line";
 	string but_got = "but got " + stringify(token.type) + " '" + token.value + "'"; // + " \e[3m\u001b[31;1m" + token.value + "\e[0m\u001b[0m"
 	return but_got;
 }
 
-void parse_rest(vector<Token> *tokens, Statement *currentStatement, int *j)
+// Token at index j, or a newline once j runs past the end, so lookaheads
+// never read outside the vector even when the input lacks a final newline
+const Token &tokenAt(vector<Token> *tokens, int j)
+{
+	static const Token end = {NEWLINE, "\n", "End of Input", 0};
+	if ((size_t)j < (*tokens).size())
+		return (*tokens)[j];
+	return end;
+}
+
+template <class Tokens>
+void parse_rest(Tokens *tokens, Statement *currentStatement, int *j)
 {
+	ALLOCATION_SITE("parser: parse_rest()");
 	int k = *j;
-	Token currentToken = (*tokens)[k];
+	Token currentToken = tokenAt(tokens, k);
 	while (k < (*tokens).size())
 	{
-		if (currentToken.value != "\n" && !((*currentStatement).validity))
+		if (currentToken.type != NEWLINE && !((*currentStatement).validity))
 		{
 			//tokens that does not need space
 			if (currentToken.type == SEMICOLON ||
@@ -496,57 +541,74 @@ void parse_rest(vector<Token> *tokens, Statement *currentStatement, int *j)
 				(*currentStatement).syntax += " " + currentToken.value;
 			}
 			k++;
-			currentToken = (*tokens)[k];
+			currentToken = tokenAt(tokens, k);
 		}
 		else
 		{
 			break;
 		}
 	}
+	// the rest of the line belongs to this statement, parsing resumes after it
+	*j = k;
+}
+
+// <value> is a constant, a "string" literal or an identifier
+template <class Tokens>
+bool parseValue(Tokens *tokens, int *j, Statement *statement)
+{
+	Token currentToken = tokenAt(tokens, *j);
+	if (currentToken.type == CONSTANT || currentToken.type == IDENTIFIER)
+	{
+		(*statement).syntax += " " + currentToken.value;
+		(*j)++;
+		return true;
+	}
+	if (currentToken.type == DELIMITER && currentToken.value == "\"" && tokenAt(tokens, *j + 1).type == CONSTANT)
+	{
+		(*statement).syntax += " \"" + tokenAt(tokens, *j + 1).value + "\"";
+		*j += 3;
+		return true;
+	}
+	(*statement).validity = false;
+	(*statement).message = "Expected constant or identifier " + but_got(currentToken);
+	return false;
 }
 
-Statement parseDeclaration(vector<Token> *tokens, int *i)
+template <class Tokens>
+Statement parseDeclaration(Analysis *analysis, Tokens *tokens, int *i)
 {
 	int j = *i;
-	Token currentToken = (*tokens)[j];
+	Token currentToken = tokenAt(tokens, j);
 
 	Statement declaration;
-	declaration.line = currentToken.line;
+	declaration.line = lineOf(analysis, currentToken);
 	declaration.syntax = "";
 	declaration.validity = true;
 	declaration.message = "";
+	declaration.start = *i;
 
 	// Check for the presence of data type
 	if (currentToken.type == DATA_TYPE)
 	{
 		declaration.syntax += currentToken.value;
 		j++;
-		currentToken = (*tokens)[j];
+		currentToken = tokenAt(tokens, j);
 
 		// Check for the presence of identifier
 		if (currentToken.type == IDENTIFIER)
 		{
 			declaration.syntax += " " + currentToken.value;
 			j++;
-			currentToken = (*tokens)[j];
+			currentToken = tokenAt(tokens, j);
 			// Check for the presence of = sign and expression
 			if (currentToken.value == "=")
 			{
 				declaration.syntax += " " + currentToken.value;
 				j++;
-				currentToken = (*tokens)[j];
+				currentToken = tokenAt(tokens, j);
 
-				if (currentToken.type == CONSTANT)
-				{
-					declaration.syntax += " " + currentToken.value;
-					j++;
-					currentToken = (*tokens)[j];
-				}
-				else
-				{
-					declaration.validity = false;
-					declaration.message = "Expected constant " + but_got(currentToken);
-				}
+				parseValue(tokens, &j, &declaration);
+				currentToken = tokenAt(tokens, j);
 				// Statement expression = parseExpression(tokens, j);
 
 				// if (!expression.validity)
@@ -590,6 +652,52 @@ Statement parseDeclaration(vector<Token> *tokens, int *i)
 	return declaration;
 }
 
+// <variable> = <value>;
+template <class Tokens>
+Statement parseAssignmentStatement(Analysis *analysis, Tokens *tokens, int *i)
+{
+	int j = *i;
+	Token currentToken = tokenAt(tokens, j);
+
+	Statement assignment;
+	assignment.line = lineOf(analysis, currentToken);
+	assignment.syntax = currentToken.value;
+	assignment.validity = true;
+	assignment.message = "";
+	assignment.start = *i;
+
+	j++;
+	currentToken = tokenAt(tokens, j);
+	if (currentToken.type == ASSIGN_OP)
+	{
+		assignment.syntax += " " + currentToken.value;
+		j++;
+		if (parseValue(tokens, &j, &assignment))
+		{
+			currentToken = tokenAt(tokens, j);
+			if (currentToken.value == ";")
+			{
+				assignment.syntax += currentToken.value;
+			}
+			else
+			{
+				assignment.validity = false;
+				assignment.message = "Expected ; " + but_got(currentToken);
+			}
+		}
+	}
+	else
+	{
+		assignment.validity = false;
+		assignment.message = "Expected = " + but_got(currentToken);
+	}
+
+	parse_rest(tokens, &assignment, &j);
+
+	*i = j;
+	return assignment;
+}
+
 // Statement parseExpression(vector<Token> *tokens, int i)
 // {
 // 	// ...
@@ -620,8 +728,30 @@ Statement parseDeclaration(vector<Token> *tokens, int *i)
 // 	// ...
 // }
 
-Statement parseStatement(vector<Token> *tokens, int *i)
+// A statement with an identifier over the --max-identifier limit is
+// invalid, besides the diagnostic the lexer reports for the identifier
+template <class Tokens>
+void checkIdentifierLengths(Analysis *analysis, Tokens *tokens, Statement *statement, int last)
+{
+	size_t limit = analysis->limits.maxIdentifier;
+	if (limit == 0 || !statement->validity)
+		return;
+	for (int j = statement->start; j <= last && j < (int)(*tokens).size(); j++)
+	{
+		const Token &token = tokenAt(tokens, j);
+		if (token.type == IDENTIFIER && token.value.size() > limit && countCodePoints(token.value) > limit)
+		{
+			statement->validity = false;
+			statement->message = "Identifier too long" + limitOf(&analysis->limits, DIAG_IDENTIFIER_TOO_LONG);
+			return;
+		}
+	}
+}
+
+template <class Tokens>
+Statement parseStatement(Analysis *analysis, Tokens *tokens, int *i)
 {
+	ALLOCATION_SITE("parser: statements");
 	Statement statement;
 
 	// Get the current token
@@ -630,11 +760,11 @@ Statement parseStatement(vector<Token> *tokens, int *i)
 	switch (currentToken.type)
 	{
 	case DATA_TYPE:
-		statement = parseDeclaration(tokens, i);
+		statement = parseDeclaration(analysis, tokens, i);
+		break;
+	case IDENTIFIER:
+		statement = parseAssignmentStatement(analysis, tokens, i);
 		break;
-	// case IDENTIFIER:
-	// 	statement = parseExpression(tokens, i);
-	// 	break;
 	// case DELIMITER:
 	// 	if (currentToken.value == "{")
 	// 	{
@@ -661,124 +791,6196 @@ Statement parseStatement(vector<Token> *tokens, int *i)
 	// 	break;
 	default:
 		int j = *i;
-		Statement invalidStatement;
-		while (j < (*tokens).size())
+		statement.line = lineOf(analysis, currentToken);
+		statement.syntax = "";
+		statement.validity = false;
+		statement.message = "Unexpected token";
+		statement.start = *i;
+		while ((size_t)j < (*tokens).size() && currentToken.type != NEWLINE)
 		{
-			if (currentToken.value != "\n")
+			if (currentToken.type == SEMICOLON ||
+				currentToken.type == CONSTANT ||
+				currentToken.type == DELIMITER ||
+				currentToken.type == ARITH_OP ||
+				currentToken.type == REL_OP ||
+				currentToken.type == LOG_OP)
 			{
-				if (currentToken.type == SEMICOLON ||
-					currentToken.type == CONSTANT ||
-					currentToken.type == DELIMITER ||
-					currentToken.type == ARITH_OP ||
-					currentToken.type == REL_OP ||
-					currentToken.type == LOG_OP)
-				{
-					invalidStatement.syntax += currentToken.value;
-				}
-				else
-				{
-					invalidStatement.syntax += currentToken.value + " ";
-				}
-				j++;
-				currentToken = (*tokens)[j];
+				statement.syntax += currentToken.value;
 			}
 			else
 			{
-				statement.line = currentToken.line;
-				statement.syntax = invalidStatement.syntax;
-				statement.validity = false;
-				statement.message = "Unexpected token";
-				*i = j;
-				break;
+				statement.syntax += currentToken.value + " ";
 			}
+			j++;
+			currentToken = tokenAt(tokens, j);
 		}
+		*i = j;
 		break;
 	}
 
+	checkIdentifierLengths(analysis, tokens, &statement, *i);
 	return statement;
 }
 
-vector<Statement> parse(vector<Token> *tokens)
+// Hands every statement that starts in [begin, end) to emit as soon as it
+// is parsed. Past the deadline of the timeout limit the rest of the range is
+// skipped and a last invalid statement says so; returns false then.
+template <class Tokens, class Emit>
+bool parseRange(Analysis *analysis, Tokens *tokens, int begin, int end, Emit emit)
 {
-	vector<Statement> statements;
-
-	// Loop through the whole token vector
-	for (int i = 0; i < (*tokens).size(); i++)
+	int parsed = 0;
+	for (int i = begin; i < end; i++)
 	{
-		Token currentToken = (*tokens)[i];
-
-		if (currentToken.value == "\n")
+		if ((*tokens)[i].type == NEWLINE)
 		{
 			continue;
 		}
-		Statement statement = parseStatement(tokens, &i);
-		statements.push_back(statement);
+		// the clock is read once every 256 statements
+		if ((++parsed & 255) == 0 && pastDeadline(&analysis->limits))
+		{
+			Statement stopped = {lineOf(analysis, (*tokens)[i]), "", false, "Time limit of " + to_string(analysis->limits.timeout) + " ms exceeded", i, i};
+			emit(stopped);
+			return false;
+		}
+		Statement statement = parseStatement(analysis, tokens, &i);
+		statement.end = i + 1;
+		emit(statement);
 	}
+	return true;
+}
 
-	return statements;
+template <class Tokens, class Emit>
+bool parseInto(Analysis *analysis, Tokens *tokens, Emit emit)
+{
+	return parseRange(analysis, tokens, 0, (*tokens).size(), emit);
 }
 
-void printSyntax(vector<Statement> statements)
+// Large inputs are split into one run of whole lines per thread. No
+// statement spans a newline, so each run parses on its own and the
+// statements are joined in source order, as if parsed serially.
+vector<Statement> parse(Analysis *analysis, vector<Token> *tokens)
 {
-	cout << endl
-		 << "LINE\t"
-		 << "SYNTAX\t\t\t\t\t"
-		 << "VALIDITY\t\t\t"
+	int n = (*tokens).size();
+	int chunks = max(1, min((int)thread::hardware_concurrency(), n / minTokensPerThread));
+	vector<int> bounds(chunks + 1, n);
+	bounds[0] = 0;
+	for (int t = 1; t < chunks; t++)
+	{
+		int i = max(bounds[t - 1], (int)((long long)n * t / chunks));
+		while (i < n && (*tokens)[i - 1].type != NEWLINE)
+		{
+			i++;
+		}
+		bounds[t] = i;
+	}
+
+	// lineOf() builds the line index on first use; do it before the threads
+	if (!analysis->lines.built)
+		buildLineIndex(&analysis->lines);
+	vector<vector<Statement>> parts(chunks);
+	vector<char> finished(chunks);
+	parallelFor(chunks, [&](int t) {
+		finished[t] = parseRange(analysis, tokens, bounds[t], bounds[t + 1], [&](Statement &statement) {
+			parts[t].push_back(move(statement));
+		});
+	});
+	// after the first run that ran out of time, the statements stop
+	for (int t = 0; t + 1 < chunks; t++)
+	{
+		if (!finished[t])
+		{
+			chunks = t + 1;
+			break;
+		}
+	}
+
+	vector<Statement> statements = move(parts[0]);
+	size_t total = 0;
+	for (const vector<Statement> &part : parts)
+	{
+		total += part.size();
+	}
+	statements.reserve(total);
+	for (int t = 1; t < chunks; t++)
+	{
+		move(parts[t].begin(), parts[t].end(), back_inserter(statements));
+	}
+	return statements;
+}
+
+// Statements of each line of the last run, found again by a hash of the
+// line's token types and spellings. No statement spans two lines, so the
+// same tokens always parse the same way. The statements of every line are
+// kept in one vector, text holds the types and spellings the hash was taken
+// over so a match is checked token for token, and slots is an
+// open-addressing index from hash to line.
+struct ParsedLine
+{
+	uint64_t hash;
+	int tokens; // -1 once the line has been reused
+	int start;	// index of its first token
+	int first;	// index of its first statement
+	int count;
+	size_t text; // where its types and spellings start in ParseCache::text
+	size_t length;
+};
+
+struct ParseCache
+{
+	vector<ParsedLine> lines;
+	vector<Statement> statements; // the statements of the run, analyzed in place
+	vector<char> parsedValid;	  // validity of each statement before the semantic pass
+	string text;
+	vector<int> slots; // -1 when unused
+	size_t reused;
+	size_t parsed;
+};
+
+// Each token's type as one byte, then its spelling and 0xFF, which never
+// occurs in UTF-8
+void appendLineText(string *out, vector<Token> *tokens, int start, int end)
+{
+	for (int i = start; i < end; i++)
+	{
+		const Token &token = (*tokens)[i];
+		out->push_back((char)token.type);
+		out->append(token.value);
+		out->push_back((char)0xFF);
+	}
+}
+
+// FNV-1a
+uint64_t hashLine(string_view text)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (char c : text)
+	{
+		hash = (hash ^ (unsigned char)c) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Line of the last run with these tokens that has not been reused yet
+ParsedLine *findLine(ParseCache *cache, uint64_t hash, int tokens, string_view text)
+{
+	if (cache->slots.empty())
+		return nullptr;
+	size_t mask = cache->slots.size() - 1;
+	for (size_t slot = hash & mask; cache->slots[slot] != -1; slot = (slot + 1) & mask)
+	{
+		ParsedLine &line = cache->lines[cache->slots[slot]];
+		if (line.hash == hash && line.tokens == tokens && string_view(cache->text).substr(line.text, line.length) == text)
+			return &line;
+	}
+	return nullptr;
+}
+
+// Indexes every line, a repeated one in as many slots, at most half full
+void indexParsedLines(ParseCache *cache)
+{
+	size_t size = 64;
+	while (size < cache->lines.size() * 2)
+	{
+		size *= 2;
+	}
+	cache->slots.assign(size, -1);
+	for (int i = 0; i < (int)cache->lines.size(); i++)
+	{
+		size_t slot = cache->lines[i].hash & (size - 1);
+		while (cache->slots[slot] != -1)
+		{
+			slot = (slot + 1) & (size - 1);
+		}
+		cache->slots[slot] = i;
+	}
+}
+
+// Fills current->statements with the same statements as parse(), but a
+// line whose tokens are unchanged since the run that filled previous is not
+// parsed again. Reused statements move from previous to current, with the
+// outcome of the last semantic pass taken back off, so current ends up with
+// exactly the lines of this run and lines edited away are dropped.
+void parseIncrementally(Analysis *analysis, vector<Token> *tokens, ParseCache *previous, ParseCache *current)
+{
+	current->statements.reserve(previous->statements.size());
+	current->parsedValid.reserve(previous->statements.size());
+	current->lines.reserve(previous->lines.size());
+	current->text.reserve(previous->text.size());
+	int n = (*tokens).size();
+	for (int start = 0; start < n;)
+	{
+		int end = start;
+		while (end < n && (*tokens)[end].type != NEWLINE)
+		{
+			end++;
+		}
+		end = min(end + 1, n);
+
+		size_t text = current->text.size();
+		appendLineText(&current->text, tokens, start, end);
+		string_view spelled = string_view(current->text).substr(text);
+		uint64_t hash = hashLine(spelled);
+		ParsedLine line = {hash, end - start, start, (int)current->statements.size(), 0, text, spelled.size()};
+		ParsedLine *known = findLine(previous, hash, end - start, spelled);
+		if (known != nullptr)
+		{
+			for (int k = known->first; k < known->first + known->count; k++)
+			{
+				Statement &statement = previous->statements[k];
+				if (previous->parsedValid[k])
+				{
+					statement.validity = true;
+					statement.message = "";
+				}
+				statement.start += start - known->start;
+				statement.end += start - known->start;
+				statement.line = lineOf(analysis, (*tokens)[statement.start]);
+				current->statements.push_back(move(statement));
+				current->parsedValid.push_back(previous->parsedValid[k]);
+			}
+			known->tokens = -1;
+			current->reused += known->count;
+		}
+		else
+		{
+			for (int i = start; i < end; i++)
+			{
+				if ((*tokens)[i].type == NEWLINE)
+				{
+					continue;
+				}
+				Statement statement = parseStatement(analysis, tokens, &i);
+				statement.end = i + 1;
+				current->parsedValid.push_back(statement.validity);
+				current->statements.push_back(move(statement));
+			}
+			current->parsed += current->statements.size() - line.first;
+		}
+		line.count = current->statements.size() - line.first;
+		current->lines.push_back(line);
+		start = end;
+	}
+	indexParsedLines(current);
+}
+
+void printSyntaxHeader()
+{
+	cout << endl
+		 << "LINE\t"
+		 << "SYNTAX\t\t\t\t\t"
+		 << "VALIDITY\t\t\t"
 		 << "MESSAGE\t\t"
 		 << endl;
-	for (int i = 0; i < statements.size(); i++)
+}
+
+void printStatement(const Statement &statement)
+{
+	cout << statement.line << "\t";
+	cout << statement.syntax << "\t\t\t\t\t";
+	if (statement.validity)
+	{
+		cout << "Valid";
+	}
+	else
+	{
+		cout << "Invalid";
+	}
+		cout << "\t\t\t";
+	cout << statement.message << endl;
+}
+
+void printSyntax(const vector<Statement> &statements)
+{
+	printSyntaxHeader();
+	for (size_t i = 0; i < statements.size(); i++)
+	{
+		printStatement(statements[i]);
+	}
+}
+
+/*============================ SEMANTIC ANALYSIS ============================================================*/
+
+// Open-addressing hash table from identifier to its innermost declaration.
+// Entering a block only records a mark; declaring a name that is already
+// visible saves the outer binding, and leaving the block restores every
+// binding saved since its mark. Each token is looked at once, so a file
+// with hundreds of thousands of declarations is analyzed in linear time.
+struct Symbol
+{
+	const string *name;
+	uint64_t hash;
+	int depth; // scope depth of the binding, emptySlot or deletedSlot when unused
+	ValueType type;
+};
+
+struct SymbolTable
+{
+	vector<Symbol> slots;
+	vector<Symbol> saved;
+	vector<size_t> marks;
+	deque<string> names; // declared names, which outlive tokens read from a TokenStore
+	size_t live;   // slots holding a binding
+	size_t filled; // live slots plus deleted ones, which still lengthen probes
+};
+
+const int emptySlot = -1;
+const int deletedSlot = -2;
+
+uint64_t hashName(const string &name)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for (unsigned char c : name)
+	{
+		hash = (hash ^ c) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Slot holding name, or the slot where it would be inserted
+size_t findSlot(SymbolTable *table, const string &name, uint64_t hash)
+{
+	size_t mask = table->slots.size() - 1;
+	size_t insertAt = SIZE_MAX;
+	for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+	{
+		Symbol &symbol = table->slots[slot];
+		if (symbol.depth == emptySlot)
+			return insertAt != SIZE_MAX ? insertAt : slot;
+		if (symbol.depth == deletedSlot)
+		{
+			if (insertAt == SIZE_MAX)
+				insertAt = slot;
+		}
+		else if (symbol.hash == hash && *symbol.name == name)
+		{
+			return slot;
+		}
+	}
+}
+
+// Rebuilds the table without deleted slots, at most a quarter full
+void rehashSymbols(SymbolTable *table)
+{
+	size_t size = 64;
+	while (size < (table->live + 1) * 4)
+	{
+		size *= 2;
+	}
+	vector<Symbol> old(size, Symbol{nullptr, 0, emptySlot, TYPE_BUUMBILANG});
+	old.swap(table->slots);
+	for (const Symbol &symbol : old)
+	{
+		if (symbol.depth >= 0)
+			table->slots[findSlot(table, *symbol.name, symbol.hash)] = symbol;
+	}
+	table->filled = table->live;
+}
+
+Symbol *lookupSymbol(SymbolTable *table, const string &name)
+{
+	Symbol *symbol = &table->slots[findSlot(table, name, hashName(name))];
+	return symbol->depth >= 0 ? symbol : nullptr;
+}
+
+// Returns false when name is already declared in the current block
+bool declareSymbol(SymbolTable *table, const string &declared, ValueType type)
+{
+	// keep at least half the slots empty so probes stay short
+	if ((table->filled + 1) * 2 > table->slots.size())
+		rehashSymbols(table);
+
+	uint64_t hash = hashName(declared);
+	int depth = table->marks.size();
+	Symbol *symbol = &table->slots[findSlot(table, declared, hash)];
+	if (symbol->depth == depth)
+		return false;
+
+	table->names.push_back(declared);
+	const string *name = &table->names.back();
+
+	if (symbol->depth >= 0)
+		table->saved.push_back(*symbol);
+	else
+	{
+		table->saved.push_back({name, hash, emptySlot, type});
+		table->live++;
+		if (symbol->depth == emptySlot)
+			table->filled++;
+	}
+	*symbol = {name, hash, depth, type};
+	return true;
+}
+
+void enterScope(SymbolTable *table)
+{
+	table->marks.push_back(table->saved.size());
+}
+
+void leaveScope(SymbolTable *table)
+{
+	size_t mark = table->marks.back();
+	table->marks.pop_back();
+	while (table->saved.size() > mark)
+	{
+		Symbol previous = table->saved.back();
+		table->saved.pop_back();
+		Symbol *symbol = &table->slots[findSlot(table, *previous.name, previous.hash)];
+		if (previous.depth == emptySlot)
+		{
+			symbol->depth = deletedSlot;
+			table->live--;
+		}
+		else
+		{
+			*symbol = previous;
+		}
+	}
+}
+
+// Type of the value starting at token j: a constant, a "string" literal
+// or a declared identifier. Returns false for an undeclared identifier.
+template <class Tokens>
+bool valueType(SymbolTable *table, Tokens *tokens, int j, ValueType *type)
+{
+	const Token &token = tokenAt(tokens, j);
+	if (token.type == IDENTIFIER)
+	{
+		Symbol *symbol = lookupSymbol(table, token.value);
+		if (symbol == nullptr)
+			return false;
+		*type = symbol->type;
+		return true;
+	}
+	if (token.type == DELIMITER)
+		*type = TYPE_STRING;
+	else if (token.description == "Boolean Constant Value")
+		*type = TYPE_BOOL;
+	else if (token.description == "Float Constant Value")
+		*type = TYPE_BAHAGIMBILANG;
+	else if (token.description == "String Constant Value")
+		*type = TYPE_STRING; // lexed by ProgramLexer, which drops the quotes
+	else
+		*type = TYPE_BUUMBILANG;
+	return true;
+}
+
+void semanticError(Statement *statement, const string &message)
+{
+	statement->validity = false;
+	statement->message = message;
+}
+
+void initSymbolTable(SymbolTable *table)
+{
+	table->slots.assign(64, Symbol{nullptr, 0, emptySlot, TYPE_BUUMBILANG});
+	table->live = 0;
+	table->filled = 0;
+}
+
+// Checks a valid declaration or assignment: redeclaration in the same
+// block, use of undeclared identifiers and values that do not fit the
+// declared type. Blocks are tracked from the { and } tokens of every
+// statement, including ones parse() could not validate.
+template <class Tokens>
+void analyzeStatement(SymbolTable *table, Tokens *tokens, Statement *statement)
+{
+	int start = statement->start;
+
+	if (statement->validity)
+	{
+		const Token &first = tokenAt(tokens, start);
+		bool declaration = first.type == DATA_TYPE;
+		int target = declaration ? start + 1 : start;
+		const string name = tokenAt(tokens, target).value;
+		ValueType type = TYPE_BUUMBILANG;
+		ValueType value;
+
+		if (declaration)
+		{
+			type = valueTypeOf(first.value);
+		}
+		else
+		{
+			Symbol *symbol = lookupSymbol(table, name);
+			if (symbol == nullptr)
+				semanticError(statement, "Use of undeclared identifier '" + name + "'");
+			else
+				type = symbol->type;
+		}
+
+		if (statement->validity && tokenAt(tokens, target + 1).type == ASSIGN_OP)
+		{
+			const string valueName = tokenAt(tokens, target + 2).value;
+			if (!valueType(table, tokens, target + 2, &value))
+				semanticError(statement, "Use of undeclared identifier '" + valueName + "'");
+			else if (!assignable(type, value))
+				semanticError(statement, "Cannot assign " + stringify(value) + " to " + stringify(type) + " '" + name + "'");
+		}
+
+		// a declaration whose value is wrong still declares the name
+		if (declaration && !declareSymbol(table, name, type) && statement->validity)
+			semanticError(statement, "Redeclaration of '" + name + "'");
+	}
+
+	for (int j = start; j < statement->end; j++)
+	{
+		const Token &token = tokenAt(tokens, j);
+		if (token.type != DELIMITER)
+			continue;
+		if (token.value == "{")
+			enterScope(table);
+		else if (token.value == "}" && !table->marks.empty())
+			leaveScope(table);
+	}
+}
+
+void analyze(vector<Token> *tokens, vector<Statement> *statements)
+{
+	SymbolTable table;
+	initSymbolTable(&table);
+	for (size_t s = 0; s < (*statements).size(); s++)
+	{
+		analyzeStatement(&table, tokens, &(*statements)[s]);
+	}
+}
+
+/*============================ OUTPUT FORMATS ===============================================================*/
+
+enum OutputFormat
+{
+	FORMAT_TABLE,
+	FORMAT_NDJSON,
+	FORMAT_CSV,
+	FORMAT_BINARY
+};
+
+const string tokenTypeNames[] = {
+	"DATA_TYPE",
+	"KEYWORD",
+	"RESERVED_WORD",
+	"IDENTIFIER",
+	"CONSTANT",
+	"ASSIGN_OP",
+	"ARITH_OP",
+	"REL_OP",
+	"LOG_OP",
+	"COMMENT",
+	"DELIMITER",
+	"SEMICOLON",
+	"NEWLINE",
+};
+
+// Streams records through a fixed buffer; nothing is allocated per record
+struct Encoder
+{
+	FILE *file;
+	size_t used;
+	// set once a write to file came up short
+	bool failed;
+	char buffer[1 << 16];
+};
+
+void flushEncoder(Encoder *e)
+{
+	if (fwrite(e->buffer, 1, e->used, e->file) != e->used)
+		e->failed = true;
+	e->used = 0;
+}
+
+void putBytes(Encoder *e, const char *data, size_t size)
+{
+	if (e->used + size > sizeof(e->buffer))
+	{
+		flushEncoder(e);
+		if (size > sizeof(e->buffer))
+		{
+			if (fwrite(data, 1, size, e->file) != size)
+				e->failed = true;
+			return;
+		}
+	}
+	memcpy(e->buffer + e->used, data, size);
+	e->used += size;
+}
+
+void putText(Encoder *e, const string &text)
+{
+	putBytes(e, text.data(), text.size());
+}
+
+void putInteger(Encoder *e, long long value)
+{
+	char number[24];
+	putBytes(e, number, to_chars(number, number + sizeof(number), value).ptr - number);
+}
+
+// Copies runs of characters that need no escaping in one go
+void putJsonString(Encoder *e, const string &value)
+{
+	static const char hex[] = "0123456789abcdef";
+	putBytes(e, "\"", 1);
+	size_t run = 0;
+	for (size_t i = 0; i < value.size(); i++)
+	{
+		unsigned char c = value[i];
+		if (c >= 0x80)
+		{
+			// a comment or string may hold bytes that are not UTF-8, which JSON cannot carry
+			int bad;
+			int length = sequenceLength((const unsigned char *)value.data(), value.size(), i, &bad);
+			if (length == 0)
+			{
+				putBytes(e, value.data() + run, i - run);
+				putBytes(e, "\\ufffd", 6);
+				run = i + bad;
+				length = bad;
+			}
+			i += length - 1;
+			continue;
+		}
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+		putBytes(e, value.data() + run, i - run);
+		run = i + 1;
+		char escape[6] = {'\\', (char)c, 0, 0, 0, 0};
+		if (c == '"' || c == '\\')
+			putBytes(e, escape, 2);
+		else if (c == '\n')
+			putBytes(e, "\\n", 2);
+		else if (c == '\t')
+			putBytes(e, "\\t", 2);
+		else if (c == '\r')
+			putBytes(e, "\\r", 2);
+		else
+		{
+			escape[1] = 'u';
+			putBytes(e, escape, 2);
+			char code[4] = {'0', '0', hex[c >> 4], hex[c & 0xF]};
+			putBytes(e, code, 4);
+		}
+	}
+	putBytes(e, value.data() + run, value.size() - run);
+	putBytes(e, "\"", 1);
+}
+
+// RFC 4180: a field is quoted when it holds a comma, quote or line break,
+// and quotes inside it are doubled
+void putCsvField(Encoder *e, const string &value)
+{
+	if (value.find_first_of(",\"\r\n") == string::npos)
+	{
+		putText(e, value);
+		return;
+	}
+	putBytes(e, "\"", 1);
+	size_t run = 0;
+	for (size_t i = 0; i < value.size(); i++)
+	{
+		if (value[i] == '"')
+		{
+			putBytes(e, value.data() + run, i + 1 - run);
+			run = i;
+		}
+	}
+	putBytes(e, value.data() + run, value.size() - run);
+	putBytes(e, "\"", 1);
+}
+
+void putU32(Encoder *e, uint32_t value)
+{
+	char bytes[4] = {(char)(value & 0xFF), (char)((value >> 8) & 0xFF), (char)((value >> 16) & 0xFF), (char)(value >> 24)};
+	putBytes(e, bytes, 4);
+}
+
+void putByte(Encoder *e, unsigned char value)
+{
+	putBytes(e, (const char *)&value, 1);
+}
+
+void putBinaryString(Encoder *e, const string &value)
+{
+	putU32(e, value.size());
+	putText(e, value);
+}
+
+// Binary files start with the magic "WKT1" (tokens) or "WKS1" (statements).
+// Every record is a little-endian u32 byte length followed by its fields;
+// integers are u32, the type and validity are one byte and strings are a
+// u32 length followed by the bytes.
+//   token:     line, index, type, value, description
+//   statement: line, validity, syntax, message
+bool writeTokens(Analysis *analysis, FILE *file, const vector<Token> &tokens, OutputFormat format)
+{
+	Encoder e;
+	e.file = file;
+	e.used = 0;
+	e.failed = false;
+
+	if (format == FORMAT_CSV)
+		putText(&e, "line,index,token,type,description\r\n");
+	else if (format == FORMAT_BINARY)
+		putBytes(&e, "WKT1", 4);
+
+	for (size_t i = 0; i < tokens.size(); i++)
+	{
+		const Token &token = tokens[i];
+		switch (format)
+		{
+		case FORMAT_NDJSON:
+			putText(&e, "{\"line\":");
+			putInteger(&e, lineOf(analysis, token));
+			putText(&e, ",\"index\":");
+			putInteger(&e, i);
+			putText(&e, ",\"token\":");
+			putJsonString(&e, token.value);
+			putText(&e, ",\"type\":\"");
+			putText(&e, tokenTypeNames[token.type]);
+			putText(&e, "\",\"description\":");
+			putJsonString(&e, token.description);
+			putText(&e, "}\n");
+			break;
+		case FORMAT_CSV:
+			putInteger(&e, lineOf(analysis, token));
+			putBytes(&e, ",", 1);
+			putInteger(&e, i);
+			putBytes(&e, ",", 1);
+			putCsvField(&e, token.value);
+			putBytes(&e, ",", 1);
+			putText(&e, tokenTypeNames[token.type]);
+			putBytes(&e, ",", 1);
+			putCsvField(&e, token.description);
+			putText(&e, "\r\n");
+			break;
+		default:
+			putU32(&e, 4 + 4 + 1 + 4 + token.value.size() + 4 + token.description.size());
+			putU32(&e, lineOf(analysis, token));
+			putU32(&e, i);
+			putByte(&e, token.type);
+			putBinaryString(&e, token.value);
+			putBinaryString(&e, token.description);
+			break;
+		}
+	}
+	flushEncoder(&e);
+	// stdout keeps the tail in its own buffer until it is flushed
+	return fflush(file) == 0 && !e.failed;
+}
+
+bool writeSyntax(FILE *file, const vector<Statement> &statements, OutputFormat format)
+{
+	Encoder e;
+	e.file = file;
+	e.used = 0;
+	e.failed = false;
+
+	if (format == FORMAT_CSV)
+		putText(&e, "line,syntax,validity,message\r\n");
+	else if (format == FORMAT_BINARY)
+		putBytes(&e, "WKS1", 4);
+
+	for (const Statement &statement : statements)
+	{
+		switch (format)
+		{
+		case FORMAT_NDJSON:
+			putText(&e, "{\"line\":");
+			putInteger(&e, statement.line);
+			putText(&e, ",\"syntax\":");
+			putJsonString(&e, statement.syntax);
+			putText(&e, statement.validity ? ",\"valid\":true" : ",\"valid\":false");
+			putText(&e, ",\"message\":");
+			putJsonString(&e, statement.message);
+			putText(&e, "}\n");
+			break;
+		case FORMAT_CSV:
+			putInteger(&e, statement.line);
+			putBytes(&e, ",", 1);
+			putCsvField(&e, statement.syntax);
+			putText(&e, statement.validity ? ",Valid," : ",Invalid,");
+			putCsvField(&e, statement.message);
+			putText(&e, "\r\n");
+			break;
+		default:
+			putU32(&e, 4 + 1 + 4 + statement.syntax.size() + 4 + statement.message.size());
+			putU32(&e, statement.line);
+			putByte(&e, statement.validity);
+			putBinaryString(&e, statement.syntax);
+			putBinaryString(&e, statement.message);
+			break;
+		}
+	}
+	flushEncoder(&e);
+	// stdout keeps the tail in its own buffer until it is flushed
+	return fflush(file) == 0 && !e.failed;
+}
+
+/*============================ PROGRAM ======================================================================*/
+
+enum NodeKind
+{
+	NODE_CONSTANT,
+	NODE_VARIABLE,
+	NODE_UNARY,
+	NODE_BINARY,
+	NODE_INPUT,
+	NODE_DECLARATION,
+	NODE_ASSIGN,
+	NODE_OUTPUT,
+	NODE_IF,
+	NODE_WHILE,
+	NODE_FOR,
+	NODE_DO_WHILE,
+	NODE_BLOCK
+};
+
+// value holds the operator, identifier or constant spelling; type is the
+// declared type of a declaration or the type of a constant
+struct Node
+{
+	NodeKind kind;
+	int line;
+	string value;
+	ValueType type;
+	vector<Node *> children;
+	// numeric constants carry the value decoded by the lexer
+	union
+	{
+		long long integer = 0;
+		double real;
+	};
+	bool inRange = true;
+};
+
+struct Program
+{
+	vector<unique_ptr<Node>> nodes;
+	Node *root;
+	bool validity;
+	int line;
+	string message;
+};
+
+struct ProgramParser
+{
+	vector<const Token *> stream;
+	size_t i;
+	size_t depth;
+	Token end;
+	Program *program;
+	Analysis *analysis;
+};
+
+Node *newNode(ProgramParser *p, NodeKind kind, int line, const string &value)
+{
+	p->program->nodes.push_back(unique_ptr<Node>(new Node{kind, line, value, TYPE_BUUMBILANG, {}}));
+	return p->program->nodes.back().get();
+}
+
+const Token *peekToken(ProgramParser *p, size_t ahead = 0)
+{
+	if (p->i + ahead < p->stream.size())
+		return p->stream[p->i + ahead];
+	return &p->end;
+}
+
+bool isToken(const Token *token, TokenType type, const string &value)
+{
+	return token->type == type && token->value == value;
+}
+
+bool failed(ProgramParser *p)
+{
+	return !p->program->validity;
+}
+
+void fail(ProgramParser *p, const Token *token, const string &message)
+{
+	// only the first error is reported, later ones are usually caused by it
+	if (failed(p))
+		return;
+	p->program->validity = false;
+	p->program->line = lineOf(p->analysis, *token);
+	p->program->message = message;
+}
+
+bool accept(ProgramParser *p, TokenType type, const string &value)
+{
+	if (isToken(peekToken(p), type, value))
+	{
+		p->i++;
+		return true;
+	}
+	return false;
+}
+
+bool expect(ProgramParser *p, TokenType type, const string &value)
+{
+	if (accept(p, type, value))
+		return true;
+	fail(p, peekToken(p), "Expected " + value + " " + but_got(*peekToken(p)));
+	return false;
+}
+
+Node *parseProgramExpression(ProgramParser *p);
+Node *parseProgramStatement(ProgramParser *p);
+
+// Deepest nesting the program parser accepts even when --max-depth is 0 or
+// larger; a parenthesis costs a frame per precedence level, and this many
+// still fit in the 8 MB main stack of an unoptimized build
+const size_t maxProgramDepth = 2000;
+
+// The program tree is walked recursively, so how deep constructs nest is
+// bounded by the maxDepth limit here rather than by the stack. Each statement,
+// parenthesis, unary operator and operator chained onto a binary
+// expression counts a level.
+bool nest(ProgramParser *p, const Token *token)
+{
+	p->depth++;
+	size_t maxDepth = p->analysis->limits.maxDepth;
+	if (maxDepth == 0 || maxDepth > maxProgramDepth)
+		maxDepth = maxProgramDepth;
+	if (p->depth > maxDepth)
+		fail(p, token, "Nested deeper than " + to_string(maxDepth) + " levels");
+	return !failed(p);
+}
+
+Node *parseNested(ProgramParser *p, Node *(*parse)(ProgramParser *))
+{
+	Node *node = nest(p, peekToken(p)) ? parse(p) : nullptr;
+	p->depth--;
+	return node;
+}
+
+Node *parsePrimary(ProgramParser *p)
+{
+	const Token *token = peekToken(p);
+
+	if (isToken(token, DELIMITER, "("))
+	{
+		p->i++;
+		Node *expression = parseNested(p, parseProgramExpression);
+		expect(p, DELIMITER, ")");
+		return expression;
+	}
+	if (isToken(token, DELIMITER, "\"") && peekToken(p, 1)->type == CONSTANT && isToken(peekToken(p, 2), DELIMITER, "\""))
+	{
+		Node *constant = newNode(p, NODE_CONSTANT, lineOf(p->analysis, *token), peekToken(p, 1)->value);
+		constant->type = TYPE_STRING;
+		p->i += 3;
+		return constant;
+	}
+	if (token->type == CONSTANT)
+	{
+		Node *constant = newNode(p, NODE_CONSTANT, lineOf(p->analysis, *token), token->value);
+		constant->integer = token->integer;
+		constant->inRange = token->inRange;
+		if (token->value == "tama" || token->value == "mali" || token->value == "true" || token->value == "false")
+		{
+			constant->type = TYPE_BOOL;
+		}
+		else if (token->description == "String Constant Value")
+		{
+			// lexed by ProgramLexer, which drops the quotes
+			constant->type = TYPE_STRING;
+		}
+		else if (token->description == "Float Constant Value")
+		{
+			constant->type = TYPE_BAHAGIMBILANG;
+		}
+		p->i++;
+		return constant;
+	}
+	if (token->type == IDENTIFIER)
+	{
+		p->i++;
+		return newNode(p, NODE_VARIABLE, lineOf(p->analysis, *token), token->value);
+	}
+	if (isToken(token, KEYWORD, "kunin"))
+	{
+		p->i++;
+		expect(p, DELIMITER, "(");
+		expect(p, DELIMITER, ")");
+		return newNode(p, NODE_INPUT, lineOf(p->analysis, *token), token->value);
+	}
+
+	fail(p, token, "Expected expression " + but_got(*token));
+	return nullptr;
+}
+
+Node *parseUnary(ProgramParser *p)
+{
+	const Token *token = peekToken(p);
+
+	if (isToken(token, LOG_OP, "hindi") || isToken(token, LOG_OP, "!"))
+	{
+		p->i++;
+		Node *unary = newNode(p, NODE_UNARY, lineOf(p->analysis, *token), "!");
+		unary->children.push_back(parseNested(p, parseUnary));
+		return unary;
+	}
+	if (isToken(token, ARITH_OP, "-"))
+	{
+		p->i++;
+		Node *unary = newNode(p, NODE_UNARY, lineOf(p->analysis, *token), "-");
+		unary->children.push_back(parseNested(p, parseUnary));
+		return unary;
+	}
+	if (isToken(token, ARITH_OP, "+"))
+	{
+		p->i++;
+		return parseNested(p, parseUnary);
+	}
+	return parsePrimary(p);
+}
+
+// Binary operators from loosest to tightest binding, parsed by precedence climbing
+const vector<vector<string>> binaryOperators = {
+	{"o_kaya"},
+	{"at"},
+	{"==", "!="},
+	{"<", "<=", ">", ">="},
+	{"+", "-"},
+	{"*", "/", "%"},
+};
+
+bool isBinaryOperator(const Token *token, size_t level)
+{
+	if (token->type != LOG_OP && token->type != REL_OP && token->type != ARITH_OP)
+		return false;
+	for (const string &op : binaryOperators[level])
+	{
+		if (token->value == op)
+			return true;
+	}
+	return false;
+}
+
+Node *parseBinary(ProgramParser *p, size_t level)
+{
+	if (level == binaryOperators.size())
+		return parseUnary(p);
+
+	Node *left = parseBinary(p, level + 1);
+	size_t chained = 0;
+	while (!failed(p) && isBinaryOperator(peekToken(p), level))
+	{
+		const Token *token = peekToken(p);
+		chained++;
+		if (!nest(p, token))
+			break;
+		p->i++;
+		Node *binary = newNode(p, NODE_BINARY, lineOf(p->analysis, *token), token->value);
+		binary->children.push_back(left);
+		binary->children.push_back(parseBinary(p, level + 1));
+		left = binary;
+	}
+	p->depth -= chained;
+	return left;
+}
+
+Node *parseProgramExpression(ProgramParser *p)
+{
+	return parseBinary(p, 0);
+}
+
+Node *parseVariableDeclaration(ProgramParser *p)
+{
+	const Token *dataType = peekToken(p);
+	p->i++;
+
+	const Token *identifier = peekToken(p);
+	if (identifier->type != IDENTIFIER)
+	{
+		fail(p, identifier, "Expected identifier " + but_got(*identifier));
+		return nullptr;
+	}
+	p->i++;
+
+	Node *declaration = newNode(p, NODE_DECLARATION, lineOf(p->analysis, *identifier), identifier->value);
+	declaration->type = valueTypeOf(dataType->value);
+	if (accept(p, ASSIGN_OP, "="))
+	{
+		declaration->children.push_back(parseProgramExpression(p));
+	}
+	return declaration;
+}
+
+// <var> = <exp>, <var> <arith_op>= <exp>, <var>++ and <var>--
+Node *parseAssignment(ProgramParser *p)
+{
+	const Token *identifier = peekToken(p);
+	p->i++;
+
+	Node *assign = newNode(p, NODE_ASSIGN, lineOf(p->analysis, *identifier), identifier->value);
+	const Token *token = peekToken(p);
+
+	if (accept(p, ASSIGN_OP, "="))
+	{
+		assign->children.push_back(parseProgramExpression(p));
+		return assign;
+	}
+	if (token->type == ARITH_OP)
+	{
+		Node *value = newNode(p, NODE_BINARY, lineOf(p->analysis, *token), token->value);
+		value->children.push_back(newNode(p, NODE_VARIABLE, lineOf(p->analysis, *identifier), identifier->value));
+		p->i++;
+
+		if ((token->value == "+" || token->value == "-") && accept(p, ARITH_OP, token->value))
+		{
+			Node *one = newNode(p, NODE_CONSTANT, lineOf(p->analysis, *token), "1");
+			one->integer = 1;
+			value->children.push_back(one);
+		}
+		else if (expect(p, ASSIGN_OP, "="))
+		{
+			value->children.push_back(parseProgramExpression(p));
+		}
+		assign->children.push_back(value);
+		return assign;
+	}
+
+	fail(p, token, "Expected = " + but_got(*token));
+	return assign;
+}
+
+Node *parseSimpleStatement(ProgramParser *p)
+{
+	const Token *token = peekToken(p);
+
+	if (token->type == DATA_TYPE)
+		return parseVariableDeclaration(p);
+	if (token->type == IDENTIFIER)
+		return parseAssignment(p);
+
+	fail(p, token, "Expected declaration or assignment " + but_got(*token));
+	return nullptr;
+}
+
+Node *parseCondition(ProgramParser *p)
+{
+	expect(p, DELIMITER, "(");
+	Node *condition = parseProgramExpression(p);
+	expect(p, DELIMITER, ")");
+	return condition;
+}
+
+Node *parseBlock(ProgramParser *p)
+{
+	const Token *token = peekToken(p);
+	Node *block = newNode(p, NODE_BLOCK, lineOf(p->analysis, *token), "{");
+
+	expect(p, DELIMITER, "{");
+	while (!failed(p) && !accept(p, DELIMITER, "}"))
+	{
+		if (p->i >= p->stream.size())
+		{
+			fail(p, token, "Expected } to close the block");
+			break;
+		}
+		block->children.push_back(parseProgramStatement(p));
+	}
+	return block;
+}
+
+// kung (<exp>) <statement> [kundi_kung (<exp>) <statement>]... [kundi <statement>]
+// kundi_kung and kundi kung both become a kung nested in the kundi branch
+Node *parseIf(ProgramParser *p)
+{
+	const Token *token = peekToken(p);
+	p->i++;
+
+	Node *statement = newNode(p, NODE_IF, lineOf(p->analysis, *token), "kung");
+	statement->children.push_back(parseCondition(p));
+	statement->children.push_back(parseProgramStatement(p));
+
+	if (isToken(peekToken(p), RESERVED_WORD, "kundi_kung"))
+	{
+		statement->children.push_back(parseNested(p, parseIf));
+	}
+	else if (accept(p, RESERVED_WORD, "kundi"))
+	{
+		statement->children.push_back(parseProgramStatement(p));
+	}
+	return statement;
+}
+
+Node *parseProgramStatement(ProgramParser *p)
+{
+	const Token *token = peekToken(p);
+	Node *statement = nullptr;
+
+	if (!nest(p, token))
+	{
+		p->depth--;
+		return nullptr;
+	}
+
+	if (token->type == DATA_TYPE || token->type == IDENTIFIER)
+	{
+		statement = parseSimpleStatement(p);
+		expect(p, SEMICOLON, ";");
+	}
+	else if (isToken(token, KEYWORD, "tignan"))
+	{
+		p->i++;
+		statement = newNode(p, NODE_OUTPUT, lineOf(p->analysis, *token), token->value);
+		expect(p, DELIMITER, "(");
+		if (!accept(p, DELIMITER, ")"))
+		{
+			do
+			{
+				statement->children.push_back(parseProgramExpression(p));
+			} while (!failed(p) && accept(p, DELIMITER, ","));
+			expect(p, DELIMITER, ")");
+		}
+		expect(p, SEMICOLON, ";");
+	}
+	else if (isToken(token, RESERVED_WORD, "kung"))
+	{
+		statement = parseIf(p);
+	}
+	else if (isToken(token, KEYWORD, "habang"))
+	{
+		p->i++;
+		statement = newNode(p, NODE_WHILE, lineOf(p->analysis, *token), token->value);
+		statement->children.push_back(parseCondition(p));
+		statement->children.push_back(parseProgramStatement(p));
+	}
+	else if (isToken(token, KEYWORD, "hanggang"))
+	{
+		// hanggang (<initialization>; <condition>; <increment>) <statement>
+		p->i++;
+		statement = newNode(p, NODE_FOR, lineOf(p->analysis, *token), token->value);
+		expect(p, DELIMITER, "(");
+		statement->children.push_back(parseSimpleStatement(p));
+		expect(p, SEMICOLON, ";");
+		statement->children.push_back(parseProgramExpression(p));
+		if (!accept(p, DELIMITER, ","))
+			expect(p, SEMICOLON, ";");
+		statement->children.push_back(parseSimpleStatement(p));
+		expect(p, DELIMITER, ")");
+		statement->children.push_back(parseProgramStatement(p));
+	}
+	else if (isToken(token, RESERVED_WORD, "gawin"))
+	{
+		// gawin <statement> habang (<condition>);
+		p->i++;
+		statement = newNode(p, NODE_DO_WHILE, lineOf(p->analysis, *token), token->value);
+		statement->children.push_back(parseProgramStatement(p));
+		expect(p, KEYWORD, "habang");
+		statement->children.insert(statement->children.begin(), parseCondition(p));
+		expect(p, SEMICOLON, ";");
+	}
+	else if (isToken(token, DELIMITER, "{"))
+	{
+		statement = parseBlock(p);
+	}
+	else if (token->type == SEMICOLON)
+	{
+		p->i++;
+		statement = newNode(p, NODE_BLOCK, lineOf(p->analysis, *token), "{");
+	}
+	else
+	{
+		fail(p, token, "Unexpected token " + but_got(*token));
+	}
+
+	p->depth--;
+	if (failed(p))
+		return nullptr;
+	return statement;
+}
+
+// Builds the syntax tree of a whole program from the token stream, skipping
+// the newline and comment tokens the line-oriented parse() relies on
+Program parseProgram(Analysis *analysis, vector<Token> *tokens)
+{
+	Program program;
+	program.validity = true;
+	program.line = 0;
+
+	ProgramParser p;
+	p.i = 0;
+	p.depth = 0;
+	p.program = &program;
+	p.analysis = analysis;
+	p.stream.reserve((*tokens).size());
+	for (size_t i = 0; i < (*tokens).size(); i++)
+	{
+		if ((*tokens)[i].type != NEWLINE && (*tokens)[i].type != COMMENT)
+			p.stream.push_back(&(*tokens)[i]);
+	}
+	p.end = {NEWLINE, "end of file", "End of File", (*tokens).empty() ? 0 : (*tokens).back().offset};
+
+	program.root = newNode(&p, NODE_BLOCK, 1, "{");
+	while (!failed(&p) && p.i < p.stream.size())
+	{
+		program.root->children.push_back(parseProgramStatement(&p));
+	}
+	return program;
+}
+
+/*============================ IR ===========================================================================*/
+
+// Before a program is compiled or translated to C it is lowered to an
+// SSA-style intermediate representation: every value is defined once, each
+// block ends in a jump or a two-way branch, and a variable assigned on more
+// than one path gets a phi where the paths join. The passes work on the IR:
+//   fold       evaluates instructions whose operands are constants
+//   propagate  sparse conditional constant propagation through variables,
+//              phis and branches
+//   branches   turns branches with a known condition into jumps and drops
+//              the blocks nothing reaches any more
+//   unused     finds the variables no remaining statement reads
+// Each pass is linear in the number of values and edges. Their results are
+// then written back into the program tree, so both backends compile the
+// simplified program. Only programs that compile are lowered: anything the
+// compiler would reject leaves the tree as it is for the backend to report.
+
+enum IrOp
+{
+	IR_CONSTANT,
+	IR_READ,  // a use of a variable, kept so the use can be replaced by its value
+	IR_STORE, // the value given to a variable, converted to its type
+	IR_INPUT,
+	IR_UNARY,
+	IR_BINARY,
+	IR_PHI,
+	IR_OUTPUT,
+	IR_BRANCH,
+	IR_JUMP
+};
+
+// Lattice of sparse conditional constant propagation
+enum IrState
+{
+	IR_UNDEFINED, // not reached, or not yet known
+	IR_KNOWN,	  // always integer, or real for bahagimbilang
+	IR_VARYING
+};
+
+struct IrValue
+{
+	IrOp op;
+	ValueType type;
+	int block;
+	string symbol;		  // operator of IR_UNARY and IR_BINARY
+	vector<int> operands; // a phi has one per predecessor of its block, in order
+	Node *node;			  // expression or kung it was lowered from
+	int variable;		  // of IR_READ, IR_STORE and IR_PHI, otherwise -1
+	int owner;			  // variable whose declaration or assignment it belongs to, or -1
+	IrState state;
+	long long integer;
+	double real;
+	bool live;
+};
+
+struct IrBlock
+{
+	vector<int> values;
+	vector<int> predecessors;
+	vector<int> successors; // a branch goes to successors[0] when its condition is true
+	bool reachable;
+	bool removed; // in the arm of a kung that is never taken
+};
+
+// The blocks of one arm of a kung: its entry and the range of blocks
+// created while lowering it
+struct IrArm
+{
+	int entry;
+	int first;
+	int end;
+};
+
+struct IrIf
+{
+	int branch;
+	IrArm arms[2];
+};
+
+struct IrVariable
+{
+	ValueType type;
+	Node *declaration;
+	vector<Node *> assignments;
+	vector<int> stores;
+	bool pinned; // a store reads input or may fail, so the variable stays
+	bool kept;
+};
+
+struct Ir
+{
+	vector<IrValue> values;
+	vector<IrBlock> blocks;
+	vector<IrVariable> variables;
+	int current; // block being lowered into
+	int owner;
+	// value each variable holds at this point of the lowering, and every
+	// change to it, so the changes made in a branch can be undone
+	vector<int> definitions;
+	vector<pair<int, int>> trail;
+	vector<int> seen;
+	vector<int> scratch;
+	int generation;
+	vector<unordered_map<string, int>> scopes;
+	vector<IrIf> ifs;
+	vector<pair<Node *, bool>> decided; // kung nodes and the arm they always take
+	bool validity;
+};
+
+int irBlock(Ir *ir)
+{
+	ir->blocks.push_back({{}, {}, {}, false, false});
+	return ir->blocks.size() - 1;
+}
+
+int irEmit(Ir *ir, IrOp op, ValueType type, Node *node, vector<int> operands, const string &symbol)
+{
+	ir->values.push_back({op, type, ir->current, symbol, move(operands), node, -1, ir->owner, IR_UNDEFINED, 0, 0.0, false});
+	ir->blocks[ir->current].values.push_back(ir->values.size() - 1);
+	return ir->values.size() - 1;
+}
+
+// Anything the compiler would reject stops the lowering
+int irFail(Ir *ir)
+{
+	ir->validity = false;
+	return irEmit(ir, IR_CONSTANT, TYPE_BUUMBILANG, nullptr, {}, "");
+}
+
+void irEdge(Ir *ir, int from, int to)
+{
+	ir->blocks[from].successors.push_back(to);
+	ir->blocks[to].predecessors.push_back(from);
+}
+
+void irJump(Ir *ir, int target)
+{
+	irEmit(ir, IR_JUMP, TYPE_BOOL, nullptr, {}, "");
+	irEdge(ir, ir->current, target);
+}
+
+void irBranch(Ir *ir, int condition, Node *node, int whenTrue, int whenFalse)
+{
+	irEmit(ir, IR_BRANCH, TYPE_BOOL, node, {condition}, "");
+	irEdge(ir, ir->current, whenTrue);
+	irEdge(ir, ir->current, whenFalse);
+}
+
+int irLookup(Ir *ir, const string &name)
+{
+	for (int s = ir->scopes.size() - 1; s >= 0; s--)
+	{
+		auto found = ir->scopes[s].find(name);
+		if (found != ir->scopes[s].end())
+			return found->second;
+	}
+	return -1;
+}
+
+void irDefine(Ir *ir, int variable, int value)
+{
+	ir->trail.push_back({variable, ir->definitions[variable]});
+	ir->definitions[variable] = value;
+}
+
+int irPhi(Ir *ir, int variable, vector<int> operands)
+{
+	int phi = irEmit(ir, IR_PHI, ir->variables[variable].type, nullptr, move(operands), "");
+	ir->values[phi].variable = variable;
+	return phi;
+}
+
+// Undoes the definitions made since mark and returns the value each
+// variable older than known held before they were undone
+vector<pair<int, int>> irUndo(Ir *ir, size_t mark, int known)
+{
+	vector<pair<int, int>> changed;
+	ir->generation++;
+	for (size_t t = ir->trail.size(); t-- > mark;)
+	{
+		int variable = ir->trail[t].first;
+		if (variable < known && ir->seen[variable] != ir->generation)
+		{
+			ir->seen[variable] = ir->generation;
+			changed.push_back({variable, ir->definitions[variable]});
+		}
+		ir->definitions[variable] = ir->trail[t].second;
+	}
+	ir->trail.resize(mark);
+	return changed;
+}
+
+// Joins the definitions at the ends of the two arms of a kung
+void irMerge(Ir *ir, const vector<pair<int, int>> &whenTrue, const vector<pair<int, int>> &whenFalse)
+{
+	int inFalse = ++ir->generation;
+	for (const pair<int, int> &changed : whenFalse)
+	{
+		ir->seen[changed.first] = inFalse;
+		ir->scratch[changed.first] = changed.second;
+	}
+	int merged = ++ir->generation;
+	for (const pair<int, int> &changed : whenTrue)
+	{
+		int variable = changed.first;
+		int other = ir->seen[variable] == inFalse ? ir->scratch[variable] : ir->definitions[variable];
+		ir->seen[variable] = merged;
+		irDefine(ir, variable, changed.second == other ? other : irPhi(ir, variable, {changed.second, other}));
+	}
+	for (const pair<int, int> &changed : whenFalse)
+	{
+		int variable = changed.first;
+		if (ir->seen[variable] != merged && changed.second != ir->definitions[variable])
+			irDefine(ir, variable, irPhi(ir, variable, {ir->definitions[variable], changed.second}));
+	}
+}
+
+bool isRelational(const string &op)
+{
+	return op == "==" || op == "!=" || op == "<" || op == "<=" || op == ">" || op == ">=";
+}
+
+// Lowers an expression, typing it the way compileExpression() does
+int lowerExpression(Ir *ir, Node *node, ValueType hint)
+{
+	switch (node->kind)
+	{
+	case NODE_CONSTANT:
+	{
+		if (!node->inRange && node->type != TYPE_STRING && node->type != TYPE_BOOL)
+			return irFail(ir);
+		int constant = irEmit(ir, IR_CONSTANT, node->type, node, {}, "");
+		IrValue &value = ir->values[constant];
+		if (node->type == TYPE_BOOL)
+			value.integer = node->value == "tama" || node->value == "true";
+		else if (node->type == TYPE_BAHAGIMBILANG)
+			value.real = node->real;
+		else if (node->type != TYPE_STRING)
+			value.integer = node->integer;
+		return constant;
+	}
+	case NODE_VARIABLE:
+	{
+		int variable = irLookup(ir, node->value);
+		if (variable < 0)
+			return irFail(ir);
+		int read = irEmit(ir, IR_READ, ir->variables[variable].type, node, {ir->definitions[variable]}, "");
+		ir->values[read].variable = variable;
+		return read;
+	}
+	case NODE_INPUT:
+		return irEmit(ir, IR_INPUT, hint, node, {}, "");
+	case NODE_UNARY:
+	{
+		int operand = lowerExpression(ir, node->children[0], hint);
+		ValueType type = ir->values[operand].type;
+		if (node->value == "!")
+			return irEmit(ir, IR_UNARY, TYPE_BOOL, node, {operand}, "!");
+		if (type == TYPE_STRING)
+			return irFail(ir);
+		return irEmit(ir, IR_UNARY, type == TYPE_BAHAGIMBILANG ? TYPE_BAHAGIMBILANG : TYPE_BUUMBILANG, node, {operand}, "-");
+	}
+	case NODE_BINARY:
+	{
+		const string &op = node->value;
+		if (op == "at" || op == "o_kaya")
+		{
+			int left = lowerExpression(ir, node->children[0], TYPE_BOOL);
+			int right = lowerExpression(ir, node->children[1], TYPE_BOOL);
+			return irEmit(ir, IR_BINARY, TYPE_BOOL, node, {left, right}, op);
+		}
+		int left = lowerExpression(ir, node->children[0], TYPE_BUUMBILANG);
+		int right = lowerExpression(ir, node->children[1], TYPE_BUUMBILANG);
+		ValueType l = ir->values[left].type;
+		ValueType r = ir->values[right].type;
+		ValueType type;
+		if (op == "+" && (l == TYPE_STRING || r == TYPE_STRING))
+			type = TYPE_STRING;
+		else if (l == TYPE_STRING || r == TYPE_STRING)
+		{
+			if (!isRelational(op) || l != r)
+				return irFail(ir);
+			type = TYPE_BOOL;
+		}
+		else if (isRelational(op))
+			type = TYPE_BOOL;
+		else
+			type = l == TYPE_BAHAGIMBILANG || r == TYPE_BAHAGIMBILANG ? TYPE_BAHAGIMBILANG : TYPE_BUUMBILANG;
+		return irEmit(ir, IR_BINARY, type, node, {left, right}, op);
+	}
+	default:
+		return irFail(ir);
+	}
+}
+
+// Lowers the value of a declaration or assignment and gives it to variable
+void lowerStore(Ir *ir, int variable, Node *value)
+{
+	IrVariable &target = ir->variables[variable];
+	ValueType type = target.type;
+	ir->owner = variable;
+	int stored;
+	if (value == nullptr)
+	{
+		stored = irEmit(ir, IR_CONSTANT, type, nullptr, {}, "");
+	}
+	else
+	{
+		stored = lowerExpression(ir, value, type);
+		if (!assignable(type, ir->values[stored].type))
+			irFail(ir);
+	}
+	int store = irEmit(ir, IR_STORE, type, nullptr, {stored}, "");
+	ir->values[store].variable = variable;
+	ir->variables[variable].stores.push_back(store);
+	ir->owner = -1;
+	irDefine(ir, variable, store);
+}
+
+// Names assigned anywhere in a statement, the candidates for a loop phi
+void assignedNames(Node *node, vector<string> *names)
+{
+	if (node->kind == NODE_ASSIGN)
+	{
+		names->push_back(node->value);
+		return;
+	}
+	if (node->kind == NODE_IF || node->kind == NODE_WHILE || node->kind == NODE_FOR || node->kind == NODE_DO_WHILE || node->kind == NODE_BLOCK)
+	{
+		for (Node *child : node->children)
+		{
+			assignedNames(child, names);
+		}
+	}
+}
+
+// Gives every variable the loop may assign a phi at the loop header, whose
+// second operand is filled in once the body has been lowered
+vector<int> lowerLoopHeader(Ir *ir, const vector<Node *> &body)
+{
+	vector<string> names;
+	for (Node *statement : body)
+	{
+		assignedNames(statement, &names);
+	}
+	vector<int> phis;
+	int carried = ++ir->generation;
+	for (const string &name : names)
+	{
+		int variable = irLookup(ir, name);
+		if (variable < 0 || ir->seen[variable] == carried)
+			continue;
+		ir->seen[variable] = carried;
+		int phi = irPhi(ir, variable, {ir->definitions[variable], -1});
+		irDefine(ir, variable, phi);
+		phis.push_back(phi);
+	}
+	return phis;
+}
+
+void closeLoop(Ir *ir, const vector<int> &phis)
+{
+	for (int phi : phis)
+	{
+		ir->values[phi].operands[1] = ir->definitions[ir->values[phi].variable];
+	}
+}
+
+void lowerStatement(Ir *ir, Node *node);
+
+void lowerScoped(Ir *ir, Node *node)
+{
+	ir->scopes.push_back({});
+	lowerStatement(ir, node);
+	ir->scopes.pop_back();
+}
+
+void lowerIf(Ir *ir, Node *node)
+{
+	int condition = lowerExpression(ir, node->children[0], TYPE_BOOL);
+	int whenTrue = irBlock(ir);
+	int whenFalse = irBlock(ir);
+	int join = irBlock(ir);
+	irBranch(ir, condition, node, whenTrue, whenFalse);
+	IrIf lowered = {(int)ir->values.size() - 1, {{whenTrue, 0, 0}, {whenFalse, 0, 0}}};
+	int known = ir->variables.size();
+	size_t mark = ir->trail.size();
+
+	ir->current = whenTrue;
+	lowered.arms[0].first = ir->blocks.size();
+	lowerScoped(ir, node->children[1]);
+	lowered.arms[0].end = ir->blocks.size();
+	irJump(ir, join);
+	vector<pair<int, int>> trueValues = irUndo(ir, mark, known);
+
+	ir->current = whenFalse;
+	lowered.arms[1].first = ir->blocks.size();
+	if (node->children.size() > 2)
+		lowerScoped(ir, node->children[2]);
+	lowered.arms[1].end = ir->blocks.size();
+	irJump(ir, join);
+	vector<pair<int, int>> falseValues = irUndo(ir, mark, known);
+	ir->ifs.push_back(lowered);
+
+	ir->current = join;
+	irMerge(ir, trueValues, falseValues);
+}
+
+// habang and hanggang test the condition in the loop header, before the
+// first iteration; gawin tests it after the body
+void lowerLoop(Ir *ir, Node *node)
+{
+	Node *condition = node->kind == NODE_FOR ? node->children[1] : node->children[0];
+	Node *body = node->kind == NODE_FOR ? node->children[3] : node->children[1];
+	vector<Node *> repeated = {body};
+	if (node->kind == NODE_FOR)
+	{
+		ir->scopes.push_back({});
+		lowerStatement(ir, node->children[0]);
+		repeated.push_back(node->children[2]);
+	}
+
+	int header = irBlock(ir);
+	int exit = irBlock(ir);
+	irJump(ir, header);
+	ir->current = header;
+	vector<int> phis = lowerLoopHeader(ir, repeated);
+	size_t mark = ir->trail.size();
+	int known = ir->variables.size();
+
+	if (node->kind == NODE_DO_WHILE)
+	{
+		lowerScoped(ir, body);
+		int test = lowerExpression(ir, condition, TYPE_BOOL);
+		closeLoop(ir, phis);
+		irBranch(ir, test, node, header, exit);
+	}
+	else
+	{
+		int test = lowerExpression(ir, condition, TYPE_BOOL);
+		int entry = irBlock(ir);
+		irBranch(ir, test, node, entry, exit);
+		ir->current = entry;
+		lowerScoped(ir, body);
+		if (node->kind == NODE_FOR)
+			lowerStatement(ir, node->children[2]);
+		closeLoop(ir, phis);
+		irJump(ir, header);
+		// the loop is left from the header, where the variables hold their phis
+		irUndo(ir, mark, known);
+	}
+	ir->current = exit;
+	if (node->kind == NODE_FOR)
+		ir->scopes.pop_back();
+}
+
+void lowerStatement(Ir *ir, Node *node)
+{
+	if (!ir->validity)
+		return;
+
+	switch (node->kind)
+	{
+	case NODE_DECLARATION:
+	{
+		if (ir->scopes.back().count(node->value) > 0)
+		{
+			irFail(ir);
+			return;
+		}
+		int variable = ir->variables.size();
+		ir->variables.push_back({node->type, node, {}, {}, false, false});
+		ir->definitions.push_back(-1);
+		ir->seen.push_back(0);
+		ir->scratch.push_back(0);
+		lowerStore(ir, variable, node->children.empty() ? nullptr : node->children[0]);
+		ir->scopes.back()[node->value] = variable;
+		break;
+	}
+	case NODE_ASSIGN:
+	{
+		int variable = irLookup(ir, node->value);
+		if (variable < 0)
+		{
+			irFail(ir);
+			return;
+		}
+		ir->variables[variable].assignments.push_back(node);
+		lowerStore(ir, variable, node->children[0]);
+		break;
+	}
+	case NODE_OUTPUT:
+	{
+		vector<int> arguments;
+		for (Node *argument : node->children)
+		{
+			arguments.push_back(lowerExpression(ir, argument, TYPE_STRING));
+		}
+		irEmit(ir, IR_OUTPUT, TYPE_STRING, node, move(arguments), "");
+		break;
+	}
+	case NODE_IF:
+		lowerIf(ir, node);
+		break;
+	case NODE_WHILE:
+	case NODE_FOR:
+	case NODE_DO_WHILE:
+		lowerLoop(ir, node);
+		break;
+	case NODE_BLOCK:
+		ir->scopes.push_back({});
+		for (Node *statement : node->children)
+		{
+			lowerStatement(ir, statement);
+		}
+		ir->scopes.pop_back();
+		break;
+	default:
+		irFail(ir);
+		break;
+	}
+}
+
+bool lowerProgram(Program *program, Ir *ir)
+{
+	ir->current = 0;
+	ir->owner = -1;
+	ir->generation = 0;
+	ir->validity = true;
+	// a statement or expression node lowers to a value or two
+	ir->values.reserve(program->nodes.size() * 2);
+	irBlock(ir);
+	ir->scopes.push_back({});
+	lowerStatement(ir, program->root);
+	return ir->validity;
+}
+
+/*--- evaluation, shared by fold and propagate ---*/
+
+struct IrResult
+{
+	IrState state;
+	long long integer;
+	double real;
+};
+
+IrResult irKnown(long long integer)
+{
+	return {IR_KNOWN, integer, 0.0};
+}
+
+IrResult irKnownReal(double real)
+{
+	return {IR_KNOWN, 0, real};
+}
+
+IrResult irState(IrState state)
+{
+	return {state, 0, 0.0};
+}
+
+// As truth() and I2F compute them at run time; strings are never known
+bool irTruth(const IrValue &value)
+{
+	return value.type == TYPE_BAHAGIMBILANG ? value.real != 0.0 : value.integer != 0;
+}
+
+double irReal(const IrValue &value)
+{
+	return value.type == TYPE_BAHAGIMBILANG ? value.real : (double)value.integer;
+}
+
+// convert(): I2F, F2I (saturating), BOOL_F and BOOL_I
+IrResult irConvert(const IrValue &value, ValueType type)
+{
+	if (value.state != IR_KNOWN)
+		return irState(value.state);
+	if (type == TYPE_BAHAGIMBILANG)
+		return irKnownReal(irReal(value));
+	if (value.type == TYPE_BAHAGIMBILANG)
+	{
+		double f = value.real;
+		if (type == TYPE_BOOL)
+			return irKnown(f != 0.0);
+		return irKnown(f != f ? 0 : f >= 9.2233720368547758e18 ? LLONG_MAX : f <= -9.2233720368547758e18 ? LLONG_MIN : (long long)f);
+	}
+	return irKnown(type == TYPE_BOOL ? value.integer != 0 : value.integer);
+}
+
+IrResult irBinary(const string &op, const IrValue &left, const IrValue &right)
+{
+	if (op == "at" || op == "o_kaya")
+	{
+		// the right operand only runs when the left does not decide
+		bool decides = op == "o_kaya";
+		if (left.state == IR_UNDEFINED)
+			return irState(IR_UNDEFINED);
+		if (left.state == IR_KNOWN && irTruth(left) == decides)
+			return irKnown(decides);
+		if (left.state == IR_VARYING || right.state != IR_KNOWN)
+			return irState(left.state == IR_VARYING ? IR_VARYING : right.state);
+		return irKnown(irTruth(right));
+	}
+	if (left.state == IR_VARYING || right.state == IR_VARYING)
+		return irState(IR_VARYING);
+	if (left.state == IR_UNDEFINED || right.state == IR_UNDEFINED)
+		return irState(IR_UNDEFINED);
+
+	if (left.type == TYPE_BAHAGIMBILANG || right.type == TYPE_BAHAGIMBILANG)
+	{
+		double a = irReal(left);
+		double b = irReal(right);
+		if (op == "+")
+			return irKnownReal(a + b);
+		if (op == "-")
+			return irKnownReal(a - b);
+		if (op == "*")
+			return irKnownReal(a * b);
+		if (op == "/")
+			return irKnownReal(a / b);
+		if (op == "%")
+			return irKnownReal(fmod(a, b));
+		if (op == "==")
+			return irKnown(a == b);
+		if (op == "!=")
+			return irKnown(a != b);
+		if (op == "<")
+			return irKnown(a < b);
+		if (op == "<=")
+			return irKnown(a <= b);
+		if (op == ">")
+			return irKnown(b < a);
+		return irKnown(b <= a);
+	}
+
+	// wraps like the interpreter; a division by zero is left to fail at run time
+	long long a = left.integer;
+	long long b = right.integer;
+	if (op == "+")
+		return irKnown((long long)((unsigned long long)a + (unsigned long long)b));
+	if (op == "-")
+		return irKnown((long long)((unsigned long long)a - (unsigned long long)b));
+	if (op == "*")
+		return irKnown((long long)((unsigned long long)a * (unsigned long long)b));
+	if (op == "/")
+		return b == 0 ? irState(IR_VARYING) : irKnown(b == -1 ? (long long)(0 - (unsigned long long)a) : a / b);
+	if (op == "%")
+		return b == 0 ? irState(IR_VARYING) : irKnown(b == -1 ? 0 : a % b);
+	if (op == "==")
+		return irKnown(a == b);
+	if (op == "!=")
+		return irKnown(a != b);
+	if (op == "<")
+		return irKnown(a < b);
+	if (op == "<=")
+		return irKnown(a <= b);
+	if (op == ">")
+		return irKnown(b < a);
+	return irKnown(b <= a);
+}
+
+// The value of an instruction from the current states of its operands.
+// Phis are met over the executable edges by propagateConstants() instead.
+IrResult irEvaluate(Ir *ir, const IrValue &value)
+{
+	switch (value.op)
+	{
+	case IR_CONSTANT:
+		if (value.type == TYPE_STRING)
+			return irState(IR_VARYING);
+		return {IR_KNOWN, value.integer, value.real};
+	case IR_READ:
+	{
+		const IrValue &operand = ir->values[value.operands[0]];
+		return {operand.state, operand.integer, operand.real};
+	}
+	case IR_STORE:
+		return irConvert(ir->values[value.operands[0]], value.type);
+	case IR_UNARY:
+	{
+		const IrValue &operand = ir->values[value.operands[0]];
+		if (operand.state != IR_KNOWN || operand.type == TYPE_STRING)
+			return irState(operand.type == TYPE_STRING ? IR_VARYING : operand.state);
+		if (value.symbol == "!")
+			return irKnown(!irTruth(operand));
+		if (operand.type == TYPE_BAHAGIMBILANG)
+			return irKnownReal(-operand.real);
+		return irKnown((long long)(0 - (unsigned long long)operand.integer));
+	}
+	case IR_BINARY:
+	{
+		const IrValue &left = ir->values[value.operands[0]];
+		const IrValue &right = ir->values[value.operands[1]];
+		if (value.type == TYPE_STRING || left.type == TYPE_STRING || right.type == TYPE_STRING)
+		{
+			// o_kaya and at may still be decided by a known left operand
+			if ((value.symbol == "at" || value.symbol == "o_kaya") && left.type != TYPE_STRING)
+				return irBinary(value.symbol, left, right);
+			return irState(IR_VARYING);
+		}
+		return irBinary(value.symbol, left, right);
+	}
+	default:
+		return irState(IR_VARYING);
+	}
+}
+
+bool sameResult(const IrValue &value, const IrResult &result)
+{
+	if (value.type == TYPE_BAHAGIMBILANG)
+		return memcmp(&value.real, &result.real, sizeof(double)) == 0;
+	return value.integer == result.integer;
+}
+
+/*--- passes ---*/
+
+// Turns every instruction whose operands are all constants into a
+// constant. Operands are lowered before their uses, so one pass in order
+// folds whole expressions and the variables they are stored in.
+int foldConstants(Ir *ir)
+{
+	int folded = 0;
+	for (IrValue &value : ir->values)
+	{
+		value.state = IR_VARYING;
+		if (value.op == IR_CONSTANT)
+		{
+			value.state = value.type == TYPE_STRING ? IR_VARYING : IR_KNOWN;
+			continue;
+		}
+		if (value.op != IR_READ && value.op != IR_STORE && value.op != IR_UNARY && value.op != IR_BINARY)
+			continue;
+		IrResult result = irEvaluate(ir, value);
+		if (result.state != IR_KNOWN)
+			continue;
+		value.op = IR_CONSTANT;
+		value.operands.clear();
+		value.state = IR_KNOWN;
+		value.integer = result.integer;
+		value.real = result.real;
+		folded++;
+	}
+	return folded;
+}
+
+// Sparse conditional constant propagation (Wegman and Zadeck): values start
+// undefined and only move down the lattice, and a block is only looked at
+// once an executable edge leads to it, so constants flow through phis and
+// past branches that can only go one way. Returns the values found constant.
+int propagateConstants(Ir *ir)
+{
+	int n = ir->values.size();
+	vector<vector<int>> users(n);
+	for (int v = 0; v < n; v++)
+	{
+		ir->values[v].state = IR_UNDEFINED;
+		for (int operand : ir->values[v].operands)
+		{
+			users[operand].push_back(v);
+		}
+	}
+	vector<vector<char>> executable(ir->blocks.size());
+	for (size_t b = 0; b < ir->blocks.size(); b++)
+	{
+		ir->blocks[b].reachable = false;
+		executable[b].assign(ir->blocks[b].predecessors.size(), 0);
+	}
+
+	vector<pair<int, int>> edges;
+	vector<int> changed;
+	auto visit = [&](int v) {
+		IrValue &value = ir->values[v];
+		const IrBlock &block = ir->blocks[value.block];
+		if (value.op == IR_JUMP)
+		{
+			edges.push_back({value.block, block.successors[0]});
+			return;
+		}
+		if (value.op == IR_BRANCH)
+		{
+			const IrValue &condition = ir->values[value.operands[0]];
+			if (condition.state == IR_KNOWN)
+				edges.push_back({value.block, block.successors[irTruth(condition) ? 0 : 1]});
+			else if (condition.state == IR_VARYING)
+			{
+				edges.push_back({value.block, block.successors[0]});
+				edges.push_back({value.block, block.successors[1]});
+			}
+			return;
+		}
+		IrResult result = irState(IR_UNDEFINED);
+		if (value.op == IR_PHI)
+		{
+			for (size_t k = 0; k < value.operands.size() && result.state != IR_VARYING; k++)
+			{
+				const IrValue &operand = ir->values[value.operands[k]];
+				if (!executable[value.block][k] || operand.state == IR_UNDEFINED)
+					continue;
+				if (operand.state == IR_VARYING || (result.state == IR_KNOWN && !sameResult(operand, result)))
+					result = irState(IR_VARYING);
+				else
+					result = {IR_KNOWN, operand.integer, operand.real};
+			}
+		}
+		else
+		{
+			result = irEvaluate(ir, value);
+		}
+		if (result.state == IR_UNDEFINED || value.state == IR_VARYING)
+			return;
+		if (value.state == IR_KNOWN && result.state == IR_KNOWN && sameResult(value, result))
+			return;
+		value.state = value.state == IR_KNOWN ? IR_VARYING : result.state;
+		value.integer = result.integer;
+		value.real = result.real;
+		changed.push_back(v);
+	};
+
+	ir->blocks[0].reachable = true;
+	for (int v : ir->blocks[0].values)
+	{
+		visit(v);
+	}
+	while (!edges.empty() || !changed.empty())
+	{
+		if (!edges.empty())
+		{
+			pair<int, int> edge = edges.back();
+			edges.pop_back();
+			IrBlock &to = ir->blocks[edge.second];
+			size_t k = find(to.predecessors.begin(), to.predecessors.end(), edge.first) - to.predecessors.begin();
+			if (executable[edge.second][k])
+				continue;
+			executable[edge.second][k] = 1;
+			if (!to.reachable)
+			{
+				to.reachable = true;
+				for (int v : to.values)
+				{
+					visit(v);
+				}
+			}
+			else
+			{
+				for (int v : to.values)
+				{
+					if (ir->values[v].op != IR_PHI)
+						break;
+					visit(v);
+				}
+			}
+			continue;
+		}
+		int v = changed.back();
+		changed.pop_back();
+		for (int user : users[v])
+		{
+			if (ir->blocks[ir->values[user].block].reachable)
+				visit(user);
+		}
+	}
+
+	int known = 0;
+	for (const IrValue &value : ir->values)
+	{
+		if (value.state == IR_KNOWN && value.op != IR_CONSTANT)
+			known++;
+	}
+	return known;
+}
+
+void removeEdge(Ir *ir, int from, int to)
+{
+	vector<int> &successors = ir->blocks[from].successors;
+	successors.erase(find(successors.begin(), successors.end(), to));
+	vector<int> &predecessors = ir->blocks[to].predecessors;
+	size_t k = find(predecessors.begin(), predecessors.end(), from) - predecessors.begin();
+	predecessors.erase(predecessors.begin() + k);
+	for (int v : ir->blocks[to].values)
+	{
+		if (ir->values[v].op != IR_PHI)
+			break;
+		ir->values[v].operands.erase(ir->values[v].operands.begin() + k);
+	}
+}
+
+void removeBlock(Ir *ir, int b)
+{
+	IrBlock &block = ir->blocks[b];
+	if (block.removed)
+		return;
+	block.removed = true;
+	while (!block.successors.empty())
+	{
+		removeEdge(ir, b, block.successors.back());
+	}
+	block.values.clear();
+}
+
+// Replaces each kung whose condition propagation found constant by a jump
+// to the arm it always takes and removes the blocks of the other arm. Other
+// unreachable blocks, such as the body of a habang (mali), stay: the
+// program tree keeps them. Returns the number of kung decided.
+int eliminateBranches(Ir *ir, int *removedBlocks)
+{
+	int decided = 0;
+	for (const IrIf &branch : ir->ifs)
+	{
+		IrValue &value = ir->values[branch.branch];
+		if (!ir->blocks[value.block].reachable || ir->values[value.operands[0]].state != IR_KNOWN)
+			continue;
+		bool taken = irTruth(ir->values[value.operands[0]]);
+		const IrArm &dead = branch.arms[taken ? 1 : 0];
+		removeEdge(ir, value.block, dead.entry);
+		value.op = IR_JUMP;
+		value.operands.clear();
+		removeBlock(ir, dead.entry);
+		for (int b = dead.first; b < dead.end; b++)
+		{
+			removeBlock(ir, b);
+		}
+		ir->decided.push_back({value.node, taken});
+		decided++;
+	}
+	*removedBlocks = 0;
+	for (const IrBlock &block : ir->blocks)
+	{
+		if (block.removed)
+			(*removedBlocks)++;
+	}
+	return decided;
+}
+
+// A known value of these types is written back as a constant; karakter
+// stays a variable because the C backend prints constants as numbers
+bool replaceable(const IrValue &value)
+{
+	return value.state == IR_KNOWN && value.node != nullptr && value.node->kind != NODE_CONSTANT &&
+		   (value.type == TYPE_BUUMBILANG || value.type == TYPE_BAHAGIMBILANG || value.type == TYPE_BOOL) &&
+		   value.op != IR_OUTPUT && value.op != IR_BRANCH && value.op != IR_JUMP;
+}
+
+// Reads input or may stop the program with a division by zero
+bool hasEffect(Ir *ir, const IrValue &value)
+{
+	if (value.op == IR_INPUT)
+		return true;
+	if (value.op != IR_BINARY || (value.symbol != "/" && value.symbol != "%") || value.type != TYPE_BUUMBILANG || replaceable(value))
+		return false;
+	const IrValue &divisor = ir->values[value.operands[1]];
+	return divisor.state != IR_KNOWN || divisor.integer == 0;
+}
+
+// Marks what the program still computes once constants are written back,
+// starting from output, input, conditions that stay and divisions that may
+// fail, in every block the program tree keeps. A variable is kept when a
+// live instruction reads it or one of its stores has an effect; the stores
+// of a kept variable stay in the program, so their operands are live too.
+// Returns the number of variables removed.
+int removeUnusedVariables(Ir *ir)
+{
+	vector<int> work;
+	auto keep = [&](int variable) {
+		if (ir->variables[variable].kept)
+			return;
+		ir->variables[variable].kept = true;
+		for (int store : ir->variables[variable].stores)
+		{
+			work.push_back(store);
+		}
+	};
+	for (IrBlock &block : ir->blocks)
+	{
+		for (int v : block.values)
+		{
+			IrValue &value = ir->values[v];
+			bool effect = hasEffect(ir, value);
+			if (effect && value.owner >= 0)
+				ir->variables[value.owner].pinned = true;
+			if (effect || value.op == IR_OUTPUT || value.op == IR_BRANCH)
+				work.push_back(v);
+		}
+	}
+	for (size_t variable = 0; variable < ir->variables.size(); variable++)
+	{
+		if (ir->variables[variable].pinned)
+			keep(variable);
+	}
+	while (!work.empty())
+	{
+		int v = work.back();
+		work.pop_back();
+		IrValue &value = ir->values[v];
+		if (value.live)
+			continue;
+		value.live = true;
+		// a replaced expression no longer reads its operands
+		if (replaceable(value))
+			continue;
+		if (value.node != nullptr && value.node->kind == NODE_VARIABLE)
+			keep(value.variable);
+		for (int operand : value.operands)
+		{
+			work.push_back(operand);
+		}
+	}
+
+	// variables declared in a removed arm are gone already
+	int removed = 0;
+	for (const IrVariable &variable : ir->variables)
+	{
+		if (!variable.kept && !ir->blocks[ir->values[variable.stores[0]].block].removed)
+			removed++;
+	}
+	return removed;
+}
+
+/*--- writing the results back ---*/
+
+// Empty statement, as parsed from a lone ;
+void clearStatement(Node *node)
+{
+	node->kind = NODE_BLOCK;
+	node->value = "{";
+	node->children.clear();
+}
+
+int rewriteProgram(Ir *ir)
+{
+	int replaced = 0;
+	for (const IrValue &value : ir->values)
+	{
+		if (!ir->blocks[value.block].reachable || !replaceable(value))
+			continue;
+		Node *node = value.node;
+		node->kind = NODE_CONSTANT;
+		node->type = value.type;
+		node->children.clear();
+		node->inRange = true;
+		if (value.type == TYPE_BOOL)
+		{
+			node->integer = value.integer;
+			node->value = value.integer ? "tama" : "mali";
+		}
+		else if (value.type == TYPE_BAHAGIMBILANG)
+		{
+			char buffer[32];
+			snprintf(buffer, sizeof(buffer), "%.17g", value.real);
+			node->real = value.real;
+			node->value = buffer;
+		}
+		else
+		{
+			node->integer = value.integer;
+			node->value = to_string(value.integer);
+		}
+		replaced++;
+	}
+
+	// the arm taken keeps its own scope inside the block
+	for (const pair<Node *, bool> &decision : ir->decided)
+	{
+		Node *node = decision.first;
+		Node *taken = decision.second ? node->children[1] : node->children.size() > 2 ? node->children[2] : nullptr;
+		clearStatement(node);
+		if (taken != nullptr)
+			node->children.push_back(taken);
+	}
+
+	for (const IrVariable &variable : ir->variables)
+	{
+		if (variable.kept)
+			continue;
+		clearStatement(variable.declaration);
+		for (Node *assignment : variable.assignments)
+		{
+			clearStatement(assignment);
+		}
+	}
+	return replaced;
+}
+
+// Runs the passes on a parsed program. With report set, the time each
+// pass takes and what it did are printed to standard error.
+void optimizeProgram(Program *program, bool report)
+{
+	auto start = chrono::steady_clock::now();
+	vector<string> rows;
+	auto lap = [&](const string &pass, const string &result) {
+		auto now = chrono::steady_clock::now();
+		char row[128];
+		snprintf(row, sizeof(row), ">> %-10s %10.3f ms  %s", pass.c_str(), chrono::duration<double, milli>(now - start).count(), result.c_str());
+		rows.push_back(row);
+		start = now;
+	};
+
+	Ir ir;
+	if (!lowerProgram(program, &ir))
+	{
+		if (report)
+			cerr << ">> IR: not lowered, the program does not compile" << endl;
+		return;
+	}
+	lap("lower", to_string(ir.values.size()) + " values in " + to_string(ir.blocks.size()) + " blocks");
+	int folded = foldConstants(&ir);
+	lap("fold", to_string(folded) + " values folded");
+	int known = propagateConstants(&ir);
+	lap("propagate", to_string(known) + " values constant");
+	int removedBlocks;
+	int decided = eliminateBranches(&ir, &removedBlocks);
+	lap("branches", to_string(decided) + " kung decided, " + to_string(removedBlocks) + " blocks removed");
+	int removed = removeUnusedVariables(&ir);
+	lap("unused", to_string(removed) + " of " + to_string(ir.variables.size()) + " variables removed");
+	int replaced = rewriteProgram(&ir);
+	lap("rewrite", to_string(replaced) + " expressions replaced by constants");
+
+	if (report)
+	{
+		for (const string &row : rows)
+		{
+			cerr << row << endl;
+		}
+	}
+}
+
+/*============================ BYTECODE =====================================================================*/
+
+// Opcodes are typed by the compiler so the interpreter never inspects tags.
+// _I works on integer slots (karakter, buumbilang and bool), _F on
+// bahagimbilang slots and _S on the string registers.
+#define WIKA_OPCODES(X)                                                           \
+	X(HALT)                                                                       \
+	X(MOVE) X(MOVS) X(LOADK) X(LOADS)                                             \
+	X(ADD_I) X(SUB_I) X(MUL_I) X(DIV_I) X(MOD_I) X(NEG_I)                         \
+	X(ADD_F) X(SUB_F) X(MUL_F) X(DIV_F) X(MOD_F) X(NEG_F)                         \
+	X(CONCAT)                                                                     \
+	X(I2F) X(F2I) X(BOOL_I) X(BOOL_F) X(BOOL_S) X(NOT)                            \
+	X(TOSTR_I) X(TOSTR_F) X(TOSTR_C)                                              \
+	X(EQ_I) X(NE_I) X(LT_I) X(LE_I)                                               \
+	X(EQ_F) X(NE_F) X(LT_F) X(LE_F)                                               \
+	X(EQ_S) X(NE_S) X(LT_S) X(LE_S)                                               \
+	X(JMP) X(JMPF) X(JMPT)                                                        \
+	X(PRINT_I) X(PRINT_F) X(PRINT_C) X(PRINT_S) X(PRINT_NL)                       \
+	X(READ_I) X(READ_F) X(READ_C) X(READ_B) X(READ_S)
+
+enum OpCode
+{
+#define WIKA_OPCODE_ENUM(name) OP_##name,
+	WIKA_OPCODES(WIKA_OPCODE_ENUM)
+#undef WIKA_OPCODE_ENUM
+};
+
+// Three 16-bit register operands; jumps and constant loads use b and c
+// together as one 32-bit operand (bx)
+struct Instruction
+{
+	uint16_t op;
+	uint16_t a;
+	uint16_t b;
+	uint16_t c;
+};
+
+inline uint32_t bx(const Instruction &instruction)
+{
+	return instruction.b | ((uint32_t)instruction.c << 16);
+}
+
+union Slot
+{
+	long long i;
+	double f;
+};
+
+struct Bytecode
+{
+	vector<Instruction> code;
+	vector<int> lines;
+	vector<Slot> constants;
+	vector<string> strings;
+	int registers;
+};
+
+struct Variable
+{
+	int reg;
+	ValueType type;
+};
+
+struct ExprResult
+{
+	int reg;
+	ValueType type;
+};
+
+struct Compiler
+{
+	Bytecode *bytecode;
+	vector<unordered_map<string, Variable>> scopes;
+	int nextReg;
+	bool validity;
+	int line;
+	string message;
+};
+
+const int maxRegisters = 65535;
+
+void compileError(Compiler *c, int line, const string &message)
+{
+	if (!c->validity)
+		return;
+	c->validity = false;
+	c->line = line;
+	c->message = message;
+}
+
+int emit(Compiler *c, OpCode op, int a, int b, int cc, int line)
+{
+	c->bytecode->code.push_back({(uint16_t)op, (uint16_t)a, (uint16_t)b, (uint16_t)cc});
+	c->bytecode->lines.push_back(line);
+	return c->bytecode->code.size() - 1;
+}
+
+int emitBx(Compiler *c, OpCode op, int a, uint32_t operand, int line)
+{
+	return emit(c, op, a, operand & 0xffff, operand >> 16, line);
+}
+
+void patchJump(Compiler *c, int at, int target)
+{
+	c->bytecode->code[at].b = target & 0xffff;
+	c->bytecode->code[at].c = (uint32_t)target >> 16;
+}
+
+int here(Compiler *c)
+{
+	return c->bytecode->code.size();
+}
+
+int allocRegister(Compiler *c, int line)
+{
+	if (c->nextReg >= maxRegisters)
+	{
+		compileError(c, line, "Program needs too many registers");
+		return 0;
+	}
+	int reg = c->nextReg++;
+	if (c->nextReg > c->bytecode->registers)
+		c->bytecode->registers = c->nextReg;
+	return reg;
+}
+
+int destination(Compiler *c, int target, int line)
+{
+	return target >= 0 ? target : allocRegister(c, line);
+}
+
+Variable *lookup(Compiler *c, const string &name)
+{
+	for (int s = c->scopes.size() - 1; s >= 0; s--)
+	{
+		auto found = c->scopes[s].find(name);
+		if (found != c->scopes[s].end())
+			return &found->second;
+	}
+	return nullptr;
+}
+
+bool isIntegral(ValueType type)
+{
+	return type == TYPE_KARAKTER || type == TYPE_BUUMBILANG || type == TYPE_BOOL;
+}
+
+void loadInteger(Compiler *c, int reg, long long value, int line)
+{
+	Slot slot;
+	slot.i = value;
+	c->bytecode->constants.push_back(slot);
+	emitBx(c, OP_LOADK, reg, c->bytecode->constants.size() - 1, line);
+}
+
+void loadFloat(Compiler *c, int reg, double value, int line)
+{
+	Slot slot;
+	slot.f = value;
+	c->bytecode->constants.push_back(slot);
+	emitBx(c, OP_LOADK, reg, c->bytecode->constants.size() - 1, line);
+}
+
+void loadString(Compiler *c, int reg, const string &value, int line)
+{
+	c->bytecode->strings.push_back(value);
+	emitBx(c, OP_LOADS, reg, c->bytecode->strings.size() - 1, line);
+}
+
+void loadDefault(Compiler *c, int reg, ValueType type, int line)
+{
+	if (type == TYPE_STRING)
+		loadString(c, reg, "", line);
+	else if (type == TYPE_BAHAGIMBILANG)
+		loadFloat(c, reg, 0.0, line);
+	else
+		loadInteger(c, reg, 0, line);
+}
+
+// Converts a value to the given type, placing it in target when one is given
+ExprResult convert(Compiler *c, ExprResult value, ValueType type, int target, int line)
+{
+	if (!assignable(type, value.type))
+	{
+		compileError(c, line, "Cannot convert " + stringify(value.type) + " to " + stringify(type));
+		return {0, type};
+	}
+	if (type == TYPE_STRING)
+	{
+		if (target >= 0 && target != value.reg)
+		{
+			emit(c, OP_MOVS, target, value.reg, 0, line);
+			return {target, type};
+		}
+		return value;
+	}
+
+	if (type == TYPE_BAHAGIMBILANG)
+	{
+		if (value.type != TYPE_BAHAGIMBILANG)
+		{
+			int reg = destination(c, target, line);
+			emit(c, OP_I2F, reg, value.reg, 0, line);
+			return {reg, type};
+		}
+	}
+	else if (value.type == TYPE_BAHAGIMBILANG)
+	{
+		int reg = destination(c, target, line);
+		emit(c, type == TYPE_BOOL ? OP_BOOL_F : OP_F2I, reg, value.reg, 0, line);
+		return {reg, type};
+	}
+	else if (type == TYPE_BOOL && value.type != TYPE_BOOL)
+	{
+		int reg = destination(c, target, line);
+		emit(c, OP_BOOL_I, reg, value.reg, 0, line);
+		return {reg, type};
+	}
+
+	if (target >= 0 && target != value.reg)
+	{
+		emit(c, OP_MOVE, target, value.reg, 0, line);
+		return {target, type};
+	}
+	return {value.reg, type};
+}
+
+// Leaves an integer slot that is non-zero exactly when the value is true
+int truth(Compiler *c, ExprResult value, int line)
+{
+	if (isIntegral(value.type))
+		return value.reg;
+	int reg = allocRegister(c, line);
+	emit(c, value.type == TYPE_STRING ? OP_BOOL_S : OP_BOOL_F, reg, value.reg, 0, line);
+	return reg;
+}
+
+int toText(Compiler *c, ExprResult value, int line)
+{
+	if (value.type == TYPE_STRING)
+		return value.reg;
+	int reg = allocRegister(c, line);
+	if (value.type == TYPE_BAHAGIMBILANG)
+		emit(c, OP_TOSTR_F, reg, value.reg, 0, line);
+	else if (value.type == TYPE_KARAKTER)
+		emit(c, OP_TOSTR_C, reg, value.reg, 0, line);
+	else
+		emit(c, OP_TOSTR_I, reg, value.reg, 0, line);
+	return reg;
+}
+
+ExprResult compileExpression(Compiler *c, Node *node, int target, ValueType hint);
+
+ExprResult compileConstant(Compiler *c, Node *node, int target)
+{
+	int reg = destination(c, target, node->line);
+	switch (node->type)
+	{
+	case TYPE_BOOL:
+		loadInteger(c, reg, node->value == "tama" || node->value == "true", node->line);
+		break;
+	case TYPE_BAHAGIMBILANG:
+		if (!node->inRange)
+			compileError(c, node->line, "Float constant " + node->value + " is out of range");
+		loadFloat(c, reg, node->real, node->line);
+		break;
+	case TYPE_STRING:
+		loadString(c, reg, node->value, node->line);
+		break;
+	default:
+		if (!node->inRange)
+			compileError(c, node->line, "Integer constant " + node->value + " is out of range");
+		loadInteger(c, reg, node->integer, node->line);
+		break;
+	}
+	return {reg, node->type};
+}
+
+ExprResult compileLogical(Compiler *c, Node *node, int target)
+{
+	// short-circuit: the right operand only runs when the left does not decide
+	int reg = allocRegister(c, node->line);
+	ExprResult left = compileExpression(c, node->children[0], -1, TYPE_BOOL);
+	emit(c, OP_BOOL_I, reg, truth(c, left, node->line), 0, node->line);
+	int jump = emitBx(c, node->value == "at" ? OP_JMPF : OP_JMPT, reg, 0, node->line);
+	ExprResult right = compileExpression(c, node->children[1], -1, TYPE_BOOL);
+	emit(c, OP_BOOL_I, reg, truth(c, right, node->line), 0, node->line);
+	patchJump(c, jump, here(c));
+	return convert(c, {reg, TYPE_BOOL}, TYPE_BOOL, target, node->line);
+}
+
+ExprResult compileBinary(Compiler *c, Node *node, int target)
+{
+	const string &op = node->value;
+	int line = node->line;
+
+	if (op == "at" || op == "o_kaya")
+		return compileLogical(c, node, target);
+
+	ExprResult left = compileExpression(c, node->children[0], -1, TYPE_BUUMBILANG);
+	ExprResult right = compileExpression(c, node->children[1], -1, TYPE_BUUMBILANG);
+	bool relational = op == "==" || op == "!=" || op == "<" || op == "<=" || op == ">" || op == ">=";
+
+	if (op == "+" && (left.type == TYPE_STRING || right.type == TYPE_STRING))
+	{
+		int l = toText(c, left, line);
+		int r = toText(c, right, line);
+		int reg = destination(c, target, line);
+		emit(c, OP_CONCAT, reg, l, r, line);
+		return {reg, TYPE_STRING};
+	}
+	if (left.type == TYPE_STRING || right.type == TYPE_STRING)
+	{
+		if (!relational || left.type != right.type)
+		{
+			compileError(c, line, "Invalid operands " + stringify(left.type) + " " + op + " " + stringify(right.type));
+			return {0, TYPE_BUUMBILANG};
+		}
+	}
+
+	// > and >= are < and <= with the operands swapped
+	if (op == ">" || op == ">=")
+		swap(left, right);
+
+	ValueType operands = TYPE_BUUMBILANG;
+	if (left.type == TYPE_STRING)
+		operands = TYPE_STRING;
+	else if (left.type == TYPE_BAHAGIMBILANG || right.type == TYPE_BAHAGIMBILANG)
+		operands = TYPE_BAHAGIMBILANG;
+	left = convert(c, left, operands, -1, line);
+	right = convert(c, right, operands, -1, line);
+
+	static const unordered_map<string, OpCode> integerOps = {
+		{"+", OP_ADD_I}, {"-", OP_SUB_I}, {"*", OP_MUL_I}, {"/", OP_DIV_I}, {"%", OP_MOD_I},
+		{"==", OP_EQ_I}, {"!=", OP_NE_I}, {"<", OP_LT_I}, {"<=", OP_LE_I}, {">", OP_LT_I}, {">=", OP_LE_I}};
+	static const unordered_map<string, OpCode> floatOps = {
+		{"+", OP_ADD_F}, {"-", OP_SUB_F}, {"*", OP_MUL_F}, {"/", OP_DIV_F}, {"%", OP_MOD_F},
+		{"==", OP_EQ_F}, {"!=", OP_NE_F}, {"<", OP_LT_F}, {"<=", OP_LE_F}, {">", OP_LT_F}, {">=", OP_LE_F}};
+	static const unordered_map<string, OpCode> stringOps = {
+		{"==", OP_EQ_S}, {"!=", OP_NE_S}, {"<", OP_LT_S}, {"<=", OP_LE_S}, {">", OP_LT_S}, {">=", OP_LE_S}};
+
+	const unordered_map<string, OpCode> &ops = operands == TYPE_STRING ? stringOps : operands == TYPE_BAHAGIMBILANG ? floatOps : integerOps;
+	int reg = destination(c, target, line);
+	emit(c, ops.at(op), reg, left.reg, right.reg, line);
+	return {reg, relational ? TYPE_BOOL : operands};
+}
+
+ExprResult compileExpression(Compiler *c, Node *node, int target, ValueType hint)
+{
+	int line = node->line;
+
+	switch (node->kind)
+	{
+	case NODE_CONSTANT:
+		return compileConstant(c, node, target);
+	case NODE_VARIABLE:
+	{
+		Variable *variable = lookup(c, node->value);
+		if (variable == nullptr)
+		{
+			compileError(c, line, "Undeclared identifier '" + node->value + "'");
+			return {0, TYPE_BUUMBILANG};
+		}
+		return convert(c, {variable->reg, variable->type}, variable->type, target, line);
+	}
+	case NODE_INPUT:
+	{
+		int reg = destination(c, target, line);
+		static const OpCode reads[] = {OP_READ_C, OP_READ_I, OP_READ_F, OP_READ_B, OP_READ_S};
+		emit(c, reads[hint], reg, 0, 0, line);
+		return {reg, hint};
+	}
+	case NODE_UNARY:
+	{
+		ExprResult operand = compileExpression(c, node->children[0], -1, hint);
+		int reg;
+		if (node->value == "!")
+		{
+			int value = truth(c, operand, line);
+			reg = destination(c, target, line);
+			emit(c, OP_NOT, reg, value, 0, line);
+			return {reg, TYPE_BOOL};
+		}
+		if (operand.type == TYPE_STRING)
+		{
+			compileError(c, line, "Invalid operand -" + stringify(operand.type));
+			return operand;
+		}
+		reg = destination(c, target, line);
+		if (operand.type == TYPE_BAHAGIMBILANG)
+		{
+			emit(c, OP_NEG_F, reg, operand.reg, 0, line);
+			return {reg, TYPE_BAHAGIMBILANG};
+		}
+		emit(c, OP_NEG_I, reg, operand.reg, 0, line);
+		return {reg, TYPE_BUUMBILANG};
+	}
+	case NODE_BINARY:
+		return compileBinary(c, node, target);
+	default:
+		compileError(c, line, "Expected expression");
+		return {0, TYPE_BUUMBILANG};
+	}
+}
+
+// Compiles the expression straight into reg, converting to the slot's type
+void compileInto(Compiler *c, Node *node, int reg, ValueType type)
+{
+	int mark = c->nextReg;
+	ExprResult value = compileExpression(c, node, -1, type);
+	convert(c, value, type, reg, node->line);
+	c->nextReg = mark;
+}
+
+void compileCondition(Compiler *c, Node *node, OpCode jump, int target)
+{
+	int mark = c->nextReg;
+	ExprResult value = compileExpression(c, node, -1, TYPE_BOOL);
+	emitBx(c, jump, truth(c, value, node->line), target, node->line);
+	c->nextReg = mark;
+}
+
+void compileStatement(Compiler *c, Node *node);
+
+void compileScoped(Compiler *c, Node *node)
+{
+	int mark = c->nextReg;
+	c->scopes.push_back({});
+	compileStatement(c, node);
+	c->scopes.pop_back();
+	c->nextReg = mark;
+}
+
+void compileStatement(Compiler *c, Node *node)
+{
+	if (!c->validity)
+		return;
+
+	int line = node->line;
+	switch (node->kind)
+	{
+	case NODE_DECLARATION:
+	{
+		if (c->scopes.back().count(node->value) > 0)
+		{
+			compileError(c, line, "Redeclaration of '" + node->value + "'");
+			return;
+		}
+		int reg = allocRegister(c, line);
+		if (node->children.empty())
+			loadDefault(c, reg, node->type, line);
+		else
+			compileInto(c, node->children[0], reg, node->type);
+		c->scopes.back()[node->value] = {reg, node->type};
+		break;
+	}
+	case NODE_ASSIGN:
+	{
+		Variable *variable = lookup(c, node->value);
+		if (variable == nullptr)
+		{
+			compileError(c, line, "Undeclared identifier '" + node->value + "'");
+			return;
+		}
+		compileInto(c, node->children[0], variable->reg, variable->type);
+		break;
+	}
+	case NODE_OUTPUT:
+	{
+		for (Node *argument : node->children)
+		{
+			int mark = c->nextReg;
+			ExprResult value = compileExpression(c, argument, -1, TYPE_STRING);
+			static const OpCode prints[] = {OP_PRINT_C, OP_PRINT_I, OP_PRINT_F, OP_PRINT_I, OP_PRINT_S};
+			emit(c, prints[value.type], value.reg, 0, 0, line);
+			c->nextReg = mark;
+		}
+		emit(c, OP_PRINT_NL, 0, 0, 0, line);
+		break;
+	}
+	case NODE_IF:
+	{
+		int mark = c->nextReg;
+		ExprResult condition = compileExpression(c, node->children[0], -1, TYPE_BOOL);
+		int skip = emitBx(c, OP_JMPF, truth(c, condition, line), 0, line);
+		c->nextReg = mark;
+		compileScoped(c, node->children[1]);
+		if (node->children.size() > 2)
+		{
+			int end = emitBx(c, OP_JMP, 0, 0, line);
+			patchJump(c, skip, here(c));
+			compileScoped(c, node->children[2]);
+			patchJump(c, end, here(c));
+		}
+		else
+		{
+			patchJump(c, skip, here(c));
+		}
+		break;
+	}
+	case NODE_WHILE:
+	{
+		// the condition sits after the body so each iteration takes one jump
+		int entry = emitBx(c, OP_JMP, 0, 0, line);
+		int body = here(c);
+		compileScoped(c, node->children[1]);
+		patchJump(c, entry, here(c));
+		compileCondition(c, node->children[0], OP_JMPT, body);
+		break;
+	}
+	case NODE_FOR:
+	{
+		int mark = c->nextReg;
+		c->scopes.push_back({});
+		compileStatement(c, node->children[0]);
+		int entry = emitBx(c, OP_JMP, 0, 0, line);
+		int body = here(c);
+		compileScoped(c, node->children[3]);
+		compileStatement(c, node->children[2]);
+		patchJump(c, entry, here(c));
+		compileCondition(c, node->children[1], OP_JMPT, body);
+		c->scopes.pop_back();
+		c->nextReg = mark;
+		break;
+	}
+	case NODE_DO_WHILE:
+	{
+		int body = here(c);
+		compileScoped(c, node->children[1]);
+		compileCondition(c, node->children[0], OP_JMPT, body);
+		break;
+	}
+	case NODE_BLOCK:
+	{
+		int mark = c->nextReg;
+		c->scopes.push_back({});
+		for (Node *statement : node->children)
+		{
+			compileStatement(c, statement);
+		}
+		c->scopes.pop_back();
+		c->nextReg = mark;
+		break;
+	}
+	default:
+		compileError(c, line, "Expected statement");
+		break;
+	}
+}
+
+Bytecode compileProgram(Program *program, bool *validity, int *line, string *message)
+{
+	Bytecode bytecode;
+	bytecode.registers = 1;
+
+	Compiler c;
+	c.bytecode = &bytecode;
+	c.nextReg = 0;
+	c.validity = true;
+	c.line = 0;
+
+	compileStatement(&c, program->root);
+	emit(&c, OP_HALT, 0, 0, 0, program->root->line);
+
+	*validity = c.validity;
+	*line = c.line;
+	*message = c.message;
+	return bytecode;
+}
+
+/*============================ INTERPRETER ==================================================================*/
+
+struct Interpreter
+{
+	string fileName;
+	vector<Slot> registers;
+	vector<string> strings;
+	string out;
+	long long executed;
+};
+
+void flushOutput(Interpreter *vm)
+{
+	fwrite(vm->out.data(), 1, vm->out.size(), stdout);
+	fflush(stdout);
+	vm->out.clear();
+}
+
+void appendInteger(string *out, long long value)
+{
+	char buffer[24];
+	auto result = to_chars(buffer, buffer + sizeof(buffer), value);
+	out->append(buffer, result.ptr);
+}
+
+void appendFloat(string *out, double value)
+{
+	char buffer[32];
+	int length = snprintf(buffer, sizeof(buffer), "%g", value);
+	out->append(buffer, length);
+}
+
+string readInput(Interpreter *vm)
+{
+	flushOutput(vm);
+	string line;
+	getline(cin, line);
+	return line;
+}
+
+bool runtimeError(Interpreter *vm, const Bytecode *bytecode, const Instruction *pc, const string &message)
+{
+	flushOutput(vm);
+	cout << vm->fileName << ": runtime error: " << message << " on line " << bytecode->lines[pc - bytecode->code.data()] << endl;
+	return false;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define WIKA_COMPUTED_GOTO
+#endif
+
+// The dispatch loop. With GCC and Clang every handler jumps straight to the
+// next one through a label table instead of returning to a central switch.
+// COUNT compiles in the executed-instruction counter used by --bench.
+template <bool COUNT>
+bool execute(const Bytecode *bytecode, Interpreter *vm)
+{
+	const Instruction *code = bytecode->code.data();
+	const Instruction *pc = code;
+	const Slot *k = bytecode->constants.data();
+	Slot *r = vm->registers.data();
+	string *s = vm->strings.data();
+	long long executed = 0;
+
+#ifdef WIKA_COMPUTED_GOTO
+#define WIKA_OPCODE_LABEL(name) &&L_##name,
+	static const void *labels[] = {WIKA_OPCODES(WIKA_OPCODE_LABEL)};
+#undef WIKA_OPCODE_LABEL
+#define VM_CASE(name) L_##name:
+#define VM_DISPATCH() goto *labels[pc->op]
+#else
+#define VM_CASE(name) case OP_##name:
+#define VM_DISPATCH() goto dispatch
+#endif
+#define VM_NEXT()          \
+	do                     \
+	{                      \
+		if (COUNT)         \
+			executed++;    \
+		pc++;              \
+		VM_DISPATCH();     \
+	} while (0)
+#define VM_JUMP(target)        \
+	do                         \
+	{                          \
+		if (COUNT)             \
+			executed++;        \
+		pc = code + (target);  \
+		VM_DISPATCH();         \
+	} while (0)
+#define A r[pc->a]
+#define B r[pc->b]
+#define C r[pc->c]
+
+#ifdef WIKA_COMPUTED_GOTO
+	VM_DISPATCH();
+#else
+dispatch:
+	switch (pc->op)
+	{
+#endif
+	VM_CASE(HALT)
+	{
+		vm->executed = executed + (COUNT ? 1 : 0);
+		flushOutput(vm);
+		return true;
+	}
+	VM_CASE(MOVE)
+	{
+		A = B;
+		VM_NEXT();
+	}
+	VM_CASE(MOVS)
+	{
+		s[pc->a] = s[pc->b];
+		VM_NEXT();
+	}
+	VM_CASE(LOADK)
+	{
+		A = k[bx(*pc)];
+		VM_NEXT();
+	}
+	VM_CASE(LOADS)
+	{
+		s[pc->a] = bytecode->strings[bx(*pc)];
+		VM_NEXT();
+	}
+	VM_CASE(ADD_I)
+	{
+		A.i = (long long)((unsigned long long)B.i + (unsigned long long)C.i);
+		VM_NEXT();
+	}
+	VM_CASE(SUB_I)
+	{
+		A.i = (long long)((unsigned long long)B.i - (unsigned long long)C.i);
+		VM_NEXT();
+	}
+	VM_CASE(MUL_I)
+	{
+		A.i = (long long)((unsigned long long)B.i * (unsigned long long)C.i);
+		VM_NEXT();
+	}
+	VM_CASE(DIV_I)
+	{
+		if (C.i == 0)
+			return runtimeError(vm, bytecode, pc, "division by zero");
+		A.i = C.i == -1 ? (long long)(0 - (unsigned long long)B.i) : B.i / C.i;
+		VM_NEXT();
+	}
+	VM_CASE(MOD_I)
+	{
+		if (C.i == 0)
+			return runtimeError(vm, bytecode, pc, "division by zero");
+		A.i = C.i == -1 ? 0 : B.i % C.i;
+		VM_NEXT();
+	}
+	VM_CASE(NEG_I)
+	{
+		A.i = (long long)(0 - (unsigned long long)B.i);
+		VM_NEXT();
+	}
+	VM_CASE(ADD_F)
+	{
+		A.f = B.f + C.f;
+		VM_NEXT();
+	}
+	VM_CASE(SUB_F)
+	{
+		A.f = B.f - C.f;
+		VM_NEXT();
+	}
+	VM_CASE(MUL_F)
+	{
+		A.f = B.f * C.f;
+		VM_NEXT();
+	}
+	VM_CASE(DIV_F)
+	{
+		A.f = B.f / C.f;
+		VM_NEXT();
+	}
+	VM_CASE(MOD_F)
+	{
+		A.f = fmod(B.f, C.f);
+		VM_NEXT();
+	}
+	VM_CASE(NEG_F)
+	{
+		A.f = -B.f;
+		VM_NEXT();
+	}
+	VM_CASE(CONCAT)
+	{
+		if (pc->a == pc->b)
+		{
+			s[pc->a] += s[pc->c];
+		}
+		else
+		{
+			string joined;
+			joined.reserve(s[pc->b].size() + s[pc->c].size());
+			joined += s[pc->b];
+			joined += s[pc->c];
+			s[pc->a].swap(joined);
+		}
+		VM_NEXT();
+	}
+	VM_CASE(I2F)
+	{
+		A.f = (double)B.i;
+		VM_NEXT();
+	}
+	VM_CASE(F2I)
+	{
+		A.i = B.f != B.f ? 0 : B.f >= 9.2233720368547758e18 ? LLONG_MAX : B.f <= -9.2233720368547758e18 ? LLONG_MIN : (long long)B.f;
+		VM_NEXT();
+	}
+	VM_CASE(BOOL_I)
+	{
+		A.i = B.i != 0;
+		VM_NEXT();
+	}
+	VM_CASE(BOOL_F)
+	{
+		A.i = B.f != 0.0;
+		VM_NEXT();
+	}
+	VM_CASE(BOOL_S)
+	{
+		A.i = !s[pc->b].empty();
+		VM_NEXT();
+	}
+	VM_CASE(NOT)
+	{
+		A.i = B.i == 0;
+		VM_NEXT();
+	}
+	VM_CASE(TOSTR_I)
+	{
+		s[pc->a].clear();
+		appendInteger(&s[pc->a], B.i);
+		VM_NEXT();
+	}
+	VM_CASE(TOSTR_F)
+	{
+		s[pc->a].clear();
+		appendFloat(&s[pc->a], B.f);
+		VM_NEXT();
+	}
+	VM_CASE(TOSTR_C)
+	{
+		s[pc->a].assign(1, (char)B.i);
+		VM_NEXT();
+	}
+	VM_CASE(EQ_I)
+	{
+		A.i = B.i == C.i;
+		VM_NEXT();
+	}
+	VM_CASE(NE_I)
+	{
+		A.i = B.i != C.i;
+		VM_NEXT();
+	}
+	VM_CASE(LT_I)
+	{
+		A.i = B.i < C.i;
+		VM_NEXT();
+	}
+	VM_CASE(LE_I)
+	{
+		A.i = B.i <= C.i;
+		VM_NEXT();
+	}
+	VM_CASE(EQ_F)
+	{
+		A.i = B.f == C.f;
+		VM_NEXT();
+	}
+	VM_CASE(NE_F)
+	{
+		A.i = B.f != C.f;
+		VM_NEXT();
+	}
+	VM_CASE(LT_F)
+	{
+		A.i = B.f < C.f;
+		VM_NEXT();
+	}
+	VM_CASE(LE_F)
+	{
+		A.i = B.f <= C.f;
+		VM_NEXT();
+	}
+	VM_CASE(EQ_S)
+	{
+		A.i = s[pc->b] == s[pc->c];
+		VM_NEXT();
+	}
+	VM_CASE(NE_S)
+	{
+		A.i = s[pc->b] != s[pc->c];
+		VM_NEXT();
+	}
+	VM_CASE(LT_S)
+	{
+		A.i = s[pc->b] < s[pc->c];
+		VM_NEXT();
+	}
+	VM_CASE(LE_S)
+	{
+		A.i = s[pc->b] <= s[pc->c];
+		VM_NEXT();
+	}
+	VM_CASE(JMP)
+	{
+		VM_JUMP(bx(*pc));
+	}
+	VM_CASE(JMPF)
+	{
+		if (A.i == 0)
+			VM_JUMP(bx(*pc));
+		VM_NEXT();
+	}
+	VM_CASE(JMPT)
+	{
+		if (A.i != 0)
+			VM_JUMP(bx(*pc));
+		VM_NEXT();
+	}
+	VM_CASE(PRINT_I)
+	{
+		appendInteger(&vm->out, A.i);
+		VM_NEXT();
+	}
+	VM_CASE(PRINT_F)
+	{
+		appendFloat(&vm->out, A.f);
+		VM_NEXT();
+	}
+	VM_CASE(PRINT_C)
+	{
+		vm->out += (char)A.i;
+		VM_NEXT();
+	}
+	VM_CASE(PRINT_S)
+	{
+		vm->out += s[pc->a];
+		VM_NEXT();
+	}
+	VM_CASE(PRINT_NL)
+	{
+		vm->out += '\n';
+		if (vm->out.size() >= 1 << 16)
+			flushOutput(vm);
+		VM_NEXT();
+	}
+	VM_CASE(READ_I)
+	{
+		A.i = strtoll(readInput(vm).c_str(), nullptr, 10);
+		VM_NEXT();
+	}
+	VM_CASE(READ_F)
+	{
+		A.f = strtod(readInput(vm).c_str(), nullptr);
+		VM_NEXT();
+	}
+	VM_CASE(READ_C)
+	{
+		string input = readInput(vm);
+		A.i = input.empty() ? 0 : (unsigned char)input[0];
+		VM_NEXT();
+	}
+	VM_CASE(READ_B)
+	{
+		string input = readInput(vm);
+		A.i = input == "tama" || input == "true" || strtoll(input.c_str(), nullptr, 10) != 0;
+		VM_NEXT();
+	}
+	VM_CASE(READ_S)
+	{
+		s[pc->a] = readInput(vm);
+		VM_NEXT();
+	}
+#ifndef WIKA_COMPUTED_GOTO
+	}
+	return false;
+#endif
+
+#undef A
+#undef B
+#undef C
+#undef VM_JUMP
+#undef VM_NEXT
+#undef VM_DISPATCH
+#undef VM_CASE
+}
+
+bool runBytecode(const Bytecode *bytecode, const string &fileName, bool count, long long *executed)
+{
+	Interpreter vm;
+	vm.fileName = fileName;
+	vm.registers.assign(bytecode->registers, Slot{0});
+	vm.strings.resize(bytecode->registers);
+	vm.out.reserve(1 << 16);
+	vm.executed = 0;
+
+	bool ok = count ? execute<true>(bytecode, &vm) : execute<false>(bytecode, &vm);
+	*executed = vm.executed;
+	return ok;
+}
+
+// Compiles and runs the tokens as a program. With bench set, the run is
+// timed and the number of executed instructions is reported.
+bool runProgram(Analysis *analysis, vector<Token> *tokens, bool bench)
+{
+	const string &fileName = analysis->fileName;
+	Program program = parseProgram(analysis, tokens);
+	if (!program.validity)
+	{
+		cout << fileName << ": error: " << program.message << " on line " << program.line << endl;
+		return false;
+	}
+	if (optimize)
+		optimizeProgram(&program, timePasses);
+
+	bool validity;
+	int line;
+	string message;
+	Bytecode bytecode = compileProgram(&program, &validity, &line, &message);
+	if (!validity)
+	{
+		cout << fileName << ": error: " << message << " on line " << line << endl;
+		return false;
+	}
+
+	long long executed = 0;
+	auto start = chrono::steady_clock::now();
+	bool ok = runBytecode(&bytecode, fileName, bench, &executed);
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	if (bench)
+	{
+		cout << endl
+			 << ">> " << bytecode.code.size() << " instructions, " << bytecode.registers << " registers" << endl
+			 << ">> Executed " << executed << " instructions in " << seconds << " s ("
+			 << (seconds > 0 ? (long long)(executed / seconds) : 0) << " instructions/s)" << endl;
+	}
+	return ok;
+}
+
+/*============================ C BACKEND ====================================================================*/
+
+// Support code placed at the top of every generated C file. Strings created
+// while evaluating a statement are temporaries released once it completes;
+// variables own a private copy. Arithmetic, conversions and output match the
+// bytecode interpreter so both backends print the same results.
+const char *cRuntime = R"(#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef struct
+{
+	char *data;
+	size_t length;
+	int owned;
+} wika_string;
+
+static const char *wika_file;
+static wika_string *wika_temps;
+static size_t wika_temp_count, wika_temp_capacity;
+
+static void wika_fail(const char *message, int line)
+{
+	fflush(stdout);
+	printf("%s: runtime error: %s on line %d\n", wika_file, message, line);
+	exit(1);
+}
+
+static wika_string wika_temp(size_t length)
+{
+	wika_string s;
+	if (wika_temp_count == wika_temp_capacity)
+	{
+		wika_temp_capacity = wika_temp_capacity ? wika_temp_capacity * 2 : 16;
+		wika_temps = (wika_string *)realloc(wika_temps, wika_temp_capacity * sizeof(wika_string));
+		if (!wika_temps)
+			wika_fail("out of memory", 0);
+	}
+	s.data = (char *)malloc(length + 1);
+	if (!s.data)
+		wika_fail("out of memory", 0);
+	s.data[length] = '\0';
+	s.length = length;
+	s.owned = 0;
+	wika_temps[wika_temp_count++] = s;
+	return s;
+}
+
+static void wika_release(void)
+{
+	while (wika_temp_count > 0)
+		free(wika_temps[--wika_temp_count].data);
+}
+
+static wika_string wika_literal(const char *data, size_t length)
+{
+	wika_string s;
+	s.data = (char *)data;
+	s.length = length;
+	s.owned = 0;
+	return s;
+}
+
+static void wika_assign(wika_string *target, wika_string value)
+{
+	char *data = (char *)malloc(value.length + 1);
+	if (!data)
+		wika_fail("out of memory", 0);
+	memcpy(data, value.data, value.length);
+	data[value.length] = '\0';
+	if (target->owned)
+		free(target->data);
+	target->data = data;
+	target->length = value.length;
+	target->owned = 1;
+}
+
+static wika_string wika_concat(wika_string a, wika_string b)
+{
+	wika_string s = wika_temp(a.length + b.length);
+	memcpy(s.data, a.data, a.length);
+	memcpy(s.data + a.length, b.data, b.length);
+	return s;
+}
+
+static int wika_compare(wika_string a, wika_string b)
+{
+	size_t n = a.length < b.length ? a.length : b.length;
+	int order = memcmp(a.data, b.data, n);
+	if (order != 0)
+		return order;
+	return a.length < b.length ? -1 : a.length > b.length;
+}
+
+static wika_string wika_from_int(long long value)
+{
+	char buffer[24];
+	int length = snprintf(buffer, sizeof(buffer), "%lld", value);
+	wika_string s = wika_temp(length);
+	memcpy(s.data, buffer, length);
+	return s;
+}
+
+static wika_string wika_from_float(double value)
+{
+	char buffer[32];
+	int length = snprintf(buffer, sizeof(buffer), "%g", value);
+	wika_string s = wika_temp(length);
+	memcpy(s.data, buffer, length);
+	return s;
+}
+
+static wika_string wika_from_char(long long value)
+{
+	wika_string s = wika_temp(1);
+	s.data[0] = (char)value;
+	return s;
+}
+
+static long long wika_add(long long a, long long b) { return (long long)((unsigned long long)a + (unsigned long long)b); }
+static long long wika_sub(long long a, long long b) { return (long long)((unsigned long long)a - (unsigned long long)b); }
+static long long wika_mul(long long a, long long b) { return (long long)((unsigned long long)a * (unsigned long long)b); }
+static long long wika_neg(long long a) { return (long long)(0 - (unsigned long long)a); }
+
+static long long wika_div(long long a, long long b, int line)
+{
+	if (b == 0)
+		wika_fail("division by zero", line);
+	return b == -1 ? wika_neg(a) : a / b;
+}
+
+static long long wika_mod(long long a, long long b, int line)
+{
+	if (b == 0)
+		wika_fail("division by zero", line);
+	return b == -1 ? 0 : a % b;
+}
+
+static long long wika_to_int(double value)
+{
+	if (value != value)
+		return 0;
+	if (value >= 9.2233720368547758e18)
+		return 0x7fffffffffffffffLL;
+	if (value <= -9.2233720368547758e18)
+		return -0x7fffffffffffffffLL - 1;
+	return (long long)value;
+}
+
+static void wika_print_int(long long value) { printf("%lld", value); }
+static void wika_print_float(double value) { printf("%g", value); }
+static void wika_print_char(long long value) { putchar((char)value); }
+static void wika_print_string(wika_string value) { fwrite(value.data, 1, value.length, stdout); }
+
+static wika_string wika_read(void)
+{
+	size_t length = 0, capacity = 64;
+	char *line = (char *)malloc(capacity);
+	int c;
+	if (!line)
+		wika_fail("out of memory", 0);
+	fflush(stdout);
+	while ((c = getchar()) != EOF && c != '\n')
+	{
+		if (length + 1 == capacity)
+		{
+			line = (char *)realloc(line, capacity *= 2);
+			if (!line)
+				wika_fail("out of memory", 0);
+		}
+		line[length++] = (char)c;
+	}
+	wika_string s = wika_temp(length);
+	memcpy(s.data, line, length);
+	free(line);
+	return s;
+}
+
+static long long wika_read_int(void) { return strtoll(wika_read().data, NULL, 10); }
+static double wika_read_float(void) { return strtod(wika_read().data, NULL); }
+static long long wika_read_char(void) { return (unsigned char)wika_read().data[0]; }
+
+static long long wika_read_bool(void)
+{
+	wika_string s = wika_read();
+	return strcmp(s.data, "tama") == 0 || strcmp(s.data, "true") == 0 || strtoll(s.data, NULL, 10) != 0;
+}
+
+)";
+
+struct CVariable
+{
+	string name;
+	ValueType type;
+};
+
+struct CEmitter
+{
+	string fileName;
+	string out;
+	vector<unordered_map<string, CVariable>> scopes;
+	int variables;
+	int depth;
+	bool validity;
+	int line;
+	string message;
+};
+
+void emitError(CEmitter *e, int line, const string &message)
+{
+	if (!e->validity)
+		return;
+	e->validity = false;
+	e->line = line;
+	e->message = message;
+}
+
+void indent(CEmitter *e)
+{
+	e->out.append(e->depth, '\t');
+}
+
+string cType(ValueType type)
+{
+	if (type == TYPE_STRING)
+		return "wika_string";
+	if (type == TYPE_BAHAGIMBILANG)
+		return "double";
+	return "long long";
+}
+
+// value with the escapes it needs inside a C string literal
+string cEscaped(const string &value)
+{
+	string literal;
+	char buffer[8];
+	for (unsigned char c : value)
+	{
+		if (c == '"' || c == '\\')
+		{
+			literal += '\\';
+			literal += c;
+		}
+		else if (c < 0x20 || c >= 0x7f)
+		{
+			// octal escapes always take three digits, so a following digit is safe
+			snprintf(buffer, sizeof(buffer), "\\%03o", c);
+			literal += buffer;
+		}
+		else
+		{
+			literal += c;
+		}
+	}
+	return literal;
+}
+
+string cStringLiteral(const string &value)
+{
+	return "wika_literal(\"" + cEscaped(value) + "\", " + to_string(value.size()) + ")";
+}
+
+// Identifiers get a numbered C name so shadowed variables and names that
+// collide with C keywords or the runtime stay distinct
+string cName(CEmitter *e, const string &name)
+{
+	string mangled = "v" + to_string(e->variables++) + "_";
+	for (unsigned char c : name)
+	{
+		mangled += isalnum(c) || c == '_' ? (char)c : '_';
+	}
+	return mangled;
+}
+
+CVariable *cLookup(CEmitter *e, const string &name)
+{
+	for (int s = e->scopes.size() - 1; s >= 0; s--)
+	{
+		auto found = e->scopes[s].find(name);
+		if (found != e->scopes[s].end())
+			return &found->second;
+	}
+	return nullptr;
+}
+
+struct CExpr
+{
+	string code;
+	ValueType type;
+};
+
+CExpr cConvert(CEmitter *e, CExpr value, ValueType type, int line)
+{
+	if (value.type == type)
+		return value;
+	if (!assignable(type, value.type))
+	{
+		emitError(e, line, "Cannot convert " + stringify(value.type) + " to " + stringify(type));
+		return {"0", type};
+	}
+	if (type == TYPE_BAHAGIMBILANG)
+		return {"(double)(" + value.code + ")", type};
+	if (value.type == TYPE_BAHAGIMBILANG)
+	{
+		if (type == TYPE_BOOL)
+			return {"(long long)((" + value.code + ") != 0.0)", type};
+		return {"wika_to_int(" + value.code + ")", type};
+	}
+	if (type == TYPE_BOOL)
+		return {"(long long)((" + value.code + ") != 0)", type};
+	return {value.code, type};
+}
+
+string cTruth(CExpr value)
+{
+	if (value.type == TYPE_STRING)
+		return "((" + value.code + ").length != 0)";
+	if (value.type == TYPE_BAHAGIMBILANG)
+		return "((" + value.code + ") != 0.0)";
+	return "((" + value.code + ") != 0)";
+}
+
+string cText(CExpr value)
+{
+	if (value.type == TYPE_STRING)
+		return value.code;
+	if (value.type == TYPE_BAHAGIMBILANG)
+		return "wika_from_float(" + value.code + ")";
+	if (value.type == TYPE_KARAKTER)
+		return "wika_from_char(" + value.code + ")";
+	return "wika_from_int(" + value.code + ")";
+}
+
+CExpr cExpression(CEmitter *e, Node *node, ValueType hint)
+{
+	int line = node->line;
+	string where = to_string(line);
+
+	switch (node->kind)
+	{
+	case NODE_CONSTANT:
+		switch (node->type)
+		{
+		case TYPE_BOOL:
+			return {node->value == "tama" || node->value == "true" ? "1LL" : "0LL", TYPE_BOOL};
+		case TYPE_BAHAGIMBILANG:
+		{
+			if (!node->inRange)
+				emitError(e, line, "Float constant " + node->value + " is out of range");
+			char buffer[32];
+			snprintf(buffer, sizeof(buffer), "%.17g", node->real);
+			string literal = buffer;
+			if (literal.find_first_of(".en") == string::npos)
+				literal += ".0";
+			return {literal, TYPE_BAHAGIMBILANG};
+		}
+		case TYPE_STRING:
+			return {cStringLiteral(node->value), TYPE_STRING};
+		default:
+		{
+			long long value = node->integer;
+			if (!node->inRange)
+				emitError(e, line, "Integer constant " + node->value + " is out of range");
+			// LLONG_MIN has no literal form in C
+			if (value == LLONG_MIN)
+				return {"(-9223372036854775807LL - 1)", TYPE_BUUMBILANG};
+			return {to_string(value) + "LL", TYPE_BUUMBILANG};
+		}
+		}
+	case NODE_VARIABLE:
+	{
+		CVariable *variable = cLookup(e, node->value);
+		if (variable == nullptr)
+		{
+			emitError(e, line, "Undeclared identifier '" + node->value + "'");
+			return {"0", TYPE_BUUMBILANG};
+		}
+		return {variable->name, variable->type};
+	}
+	case NODE_INPUT:
+		switch (hint)
+		{
+		case TYPE_KARAKTER:
+			return {"wika_read_char()", hint};
+		case TYPE_BAHAGIMBILANG:
+			return {"wika_read_float()", hint};
+		case TYPE_BOOL:
+			return {"wika_read_bool()", hint};
+		case TYPE_STRING:
+			return {"wika_read()", hint};
+		default:
+			return {"wika_read_int()", hint};
+		}
+	case NODE_UNARY:
+	{
+		CExpr operand = cExpression(e, node->children[0], hint);
+		if (node->value == "!")
+			return {"(long long)!" + cTruth(operand), TYPE_BOOL};
+		if (operand.type == TYPE_STRING)
+		{
+			emitError(e, line, "Invalid operand -" + stringify(operand.type));
+			return operand;
+		}
+		if (operand.type == TYPE_BAHAGIMBILANG)
+			return {"(-(" + operand.code + "))", TYPE_BAHAGIMBILANG};
+		return {"wika_neg(" + operand.code + ")", TYPE_BUUMBILANG};
+	}
+	case NODE_BINARY:
+	{
+		const string &op = node->value;
+		CExpr left = cExpression(e, node->children[0], TYPE_BUUMBILANG);
+		CExpr right = cExpression(e, node->children[1], TYPE_BUUMBILANG);
+
+		if (op == "at" || op == "o_kaya")
+			return {"(long long)(" + cTruth(left) + (op == "at" ? " && " : " || ") + cTruth(right) + ")", TYPE_BOOL};
+
+		bool relational = op == "==" || op == "!=" || op == "<" || op == "<=" || op == ">" || op == ">=";
+		if (op == "+" && (left.type == TYPE_STRING || right.type == TYPE_STRING))
+			return {"wika_concat(" + cText(left) + ", " + cText(right) + ")", TYPE_STRING};
+		if (left.type == TYPE_STRING || right.type == TYPE_STRING)
+		{
+			if (!relational || left.type != right.type)
+			{
+				emitError(e, line, "Invalid operands " + stringify(left.type) + " " + op + " " + stringify(right.type));
+				return {"0", TYPE_BUUMBILANG};
+			}
+			return {"(long long)(wika_compare(" + left.code + ", " + right.code + ") " + op + " 0)", TYPE_BOOL};
+		}
+
+		ValueType operands = left.type == TYPE_BAHAGIMBILANG || right.type == TYPE_BAHAGIMBILANG ? TYPE_BAHAGIMBILANG : TYPE_BUUMBILANG;
+		left = cConvert(e, left, operands, line);
+		right = cConvert(e, right, operands, line);
+		if (relational)
+			return {"(long long)((" + left.code + ") " + op + " (" + right.code + "))", TYPE_BOOL};
+		if (operands == TYPE_BAHAGIMBILANG)
+		{
+			if (op == "%")
+				return {"fmod(" + left.code + ", " + right.code + ")", operands};
+			return {"((" + left.code + ") " + op + " (" + right.code + "))", operands};
+		}
+
+		static const unordered_map<string, string> integerOps = {
+			{"+", "wika_add"}, {"-", "wika_sub"}, {"*", "wika_mul"}, {"/", "wika_div"}, {"%", "wika_mod"}};
+		string call = integerOps.at(op) + "(" + left.code + ", " + right.code;
+		if (op == "/" || op == "%")
+			call += ", " + where;
+		return {call + ")", operands};
+	}
+	default:
+		emitError(e, line, "Expected expression");
+		return {"0", TYPE_BUUMBILANG};
+	}
+}
+
+void cStatement(CEmitter *e, Node *node);
+
+// Emits node as a C block with its own scope. Bodies start by releasing
+// the temporaries left by the condition that led into them.
+void cScoped(CEmitter *e, Node *node)
+{
+	indent(e);
+	e->out += "{\n";
+	e->depth++;
+	indent(e);
+	e->out += "wika_release();\n";
+	e->scopes.push_back({});
+	cStatement(e, node);
+	e->scopes.pop_back();
+	e->depth--;
+	indent(e);
+	e->out += "}\n";
+}
+
+// Every statement is preceded by a #line directive so C compiler
+// diagnostics and debuggers point at the .wika source
+void cLine(CEmitter *e, int line)
+{
+	e->out += "#line " + to_string(line) + " \"" + cEscaped(e->fileName) + "\"\n";
+}
+
+void cStatement(CEmitter *e, Node *node)
+{
+	if (!e->validity)
+		return;
+
+	int line = node->line;
+	switch (node->kind)
+	{
+	case NODE_DECLARATION:
+	{
+		if (e->scopes.back().count(node->value) > 0)
+		{
+			emitError(e, line, "Redeclaration of '" + node->value + "'");
+			return;
+		}
+		cLine(e, line);
+		CVariable variable = {cName(e, node->value), node->type};
+		indent(e);
+		if (node->type == TYPE_STRING)
+		{
+			e->out += "wika_string " + variable.name + " = {(char *)\"\", 0, 0};\n";
+			if (!node->children.empty())
+			{
+				CExpr value = cConvert(e, cExpression(e, node->children[0], node->type), node->type, line);
+				indent(e);
+				e->out += "wika_assign(&" + variable.name + ", " + value.code + ");\n";
+				indent(e);
+				e->out += "wika_release();\n";
+			}
+		}
+		else
+		{
+			string value = node->type == TYPE_BAHAGIMBILANG ? "0.0" : "0";
+			if (!node->children.empty())
+				value = cConvert(e, cExpression(e, node->children[0], node->type), node->type, line).code;
+			e->out += cType(node->type) + " " + variable.name + " = " + value + ";\n";
+		}
+		e->scopes.back()[node->value] = variable;
+		break;
+	}
+	case NODE_ASSIGN:
+	{
+		CVariable *variable = cLookup(e, node->value);
+		if (variable == nullptr)
+		{
+			emitError(e, line, "Undeclared identifier '" + node->value + "'");
+			return;
+		}
+		cLine(e, line);
+		CExpr value = cConvert(e, cExpression(e, node->children[0], variable->type), variable->type, line);
+		indent(e);
+		if (variable->type == TYPE_STRING)
+		{
+			e->out += "wika_assign(&" + variable->name + ", " + value.code + ");\n";
+			indent(e);
+			e->out += "wika_release();\n";
+		}
+		else
+		{
+			e->out += variable->name + " = " + value.code + ";\n";
+		}
+		break;
+	}
+	case NODE_OUTPUT:
+	{
+		cLine(e, line);
+		for (Node *argument : node->children)
+		{
+			CExpr value = cExpression(e, argument, TYPE_STRING);
+			static const char *prints[] = {"wika_print_char", "wika_print_int", "wika_print_float", "wika_print_int", "wika_print_string"};
+			indent(e);
+			e->out += string(prints[value.type]) + "(" + value.code + ");\n";
+		}
+		indent(e);
+		e->out += "putchar('\\n');\n";
+		indent(e);
+		e->out += "wika_release();\n";
+		break;
+	}
+	case NODE_IF:
+	{
+		cLine(e, line);
+		indent(e);
+		e->out += "if " + cTruth(cExpression(e, node->children[0], TYPE_BOOL)) + "\n";
+		cScoped(e, node->children[1]);
+		if (node->children.size() > 2)
+		{
+			indent(e);
+			e->out += "else\n";
+			cScoped(e, node->children[2]);
+		}
+		break;
+	}
+	case NODE_WHILE:
+	{
+		cLine(e, line);
+		indent(e);
+		e->out += "while " + cTruth(cExpression(e, node->children[0], TYPE_BOOL)) + "\n";
+		cScoped(e, node->children[1]);
+		break;
+	}
+	case NODE_FOR:
+	{
+		indent(e);
+		e->out += "{\n";
+		e->depth++;
+		e->scopes.push_back({});
+		cStatement(e, node->children[0]);
+		cLine(e, line);
+		indent(e);
+		e->out += "while " + cTruth(cExpression(e, node->children[1], TYPE_BOOL)) + "\n";
+		indent(e);
+		e->out += "{\n";
+		e->depth++;
+		cScoped(e, node->children[3]);
+		cStatement(e, node->children[2]);
+		e->depth--;
+		indent(e);
+		e->out += "}\n";
+		e->scopes.pop_back();
+		e->depth--;
+		indent(e);
+		e->out += "}\n";
+		break;
+	}
+	case NODE_DO_WHILE:
+	{
+		cLine(e, line);
+		indent(e);
+		e->out += "do\n";
+		cScoped(e, node->children[1]);
+		cLine(e, node->children[0]->line);
+		indent(e);
+		e->out += "while " + cTruth(cExpression(e, node->children[0], TYPE_BOOL)) + ";\n";
+		break;
+	}
+	case NODE_BLOCK:
+	{
+		e->scopes.push_back({});
+		for (Node *statement : node->children)
+		{
+			cStatement(e, statement);
+		}
+		e->scopes.pop_back();
+		break;
+	}
+	default:
+		emitError(e, line, "Expected statement");
+		break;
+	}
+}
+
+// Translates a parsed program into a standalone C source file
+string emitC(Program *program, const string &fileName, bool *validity, int *line, string *message)
+{
+	CEmitter e;
+	e.fileName = fileName;
+	e.variables = 0;
+	e.depth = 1;
+	e.validity = true;
+	e.line = 0;
+
+	e.out = cRuntime;
+	e.out += "int main(void)\n{\n\twika_file = " + cStringLiteral(fileName) + ".data;\n";
+	cStatement(&e, program->root);
+	e.out += "\treturn 0;\n}\n";
+
+	*validity = e.validity;
+	*line = e.line;
+	*message = e.message;
+	return e.out;
+}
+
+// path as one word of a command for system() or popen()
+string shellQuote(const string &path)
+{
+#ifdef _WIN32
+	return "\"" + path + "\"";
+#else
+	string quoted = "'";
+	for (char c : path)
+	{
+		if (c == '\'')
+			quoted += "'\\''";
+		else
+			quoted += c;
+	}
+	return quoted + "'";
+#endif
+}
+
+// Writes the program as C to cFile and, when executable is not empty,
+// builds it with the C compiler named by $CC (cc by default). Unless keepC
+// is set, cFile is only a temporary for the build and is removed after it.
+bool compileNative(Analysis *analysis, vector<Token> *tokens, const string &cFile, const string &executable, bool keepC)
+{
+	const string &fileName = analysis->fileName;
+	Program program = parseProgram(analysis, tokens);
+	if (!program.validity)
+	{
+		cout << fileName << ": error: " << program.message << " on line " << program.line << endl;
+		return false;
+	}
+	if (optimize)
+		optimizeProgram(&program, timePasses);
+
+	bool validity;
+	int line;
+	string message;
+	string source = emitC(&program, fileName, &validity, &line, &message);
+	if (!validity)
+	{
+		cout << fileName << ": error: " << message << " on line " << line << endl;
+		return false;
+	}
+
+	ofstream file(cFile, ios::binary);
+	if (!file.is_open())
+	{
+		cout << "Error: cannot write " << cFile << endl;
+		return false;
+	}
+	file << source;
+	file.close();
+
+	if (executable.empty())
+	{
+		cout << ">> C source generated: " << cFile << endl;
+		return true;
+	}
+
+	const char *cc = getenv("CC");
+	string command = string(cc != nullptr && *cc != '\0' ? cc : "cc") + " -O2 -o " + shellQuote(executable) + " " + shellQuote(cFile) + " -lm";
+	if (system(command.c_str()) != 0)
+	{
+		cout << "Error: C compiler failed: " << command << endl;
+		return false;
+	}
+	if (!keepC)
+		remove(cFile.c_str());
+	cout << ">> Native executable generated: " << executable << endl;
+	return true;
+}
+
+/*============================ WATCH MODE ===================================================================*/
+
+// --watch dir: analyzes every .wika file under dir, then waits for inotify
+// events and re-analyzes only the files that were written, moved in or
+// removed. Events that arrive within watchQuietMs of each other are
+// handled as one batch, so an editor that writes a file in several steps
+// causes one re-analysis. Each file's symbol table goes next to it as
+// <name>.symtab and its report to standard output. Only the lines that
+// changed since the last analysis of a file are parsed again.
+struct WatchedFile
+{
+	string input;
+	size_t tokens;
+	size_t statements;
+	size_t invalid;
+	ParseCache parses;
+};
+
+const int watchQuietMs = 30;
+
+bool isWikaFile(const string &path)
+{
+	return path.size() > 5 && path.compare(path.size() - 5, 5, ".wika") == 0;
+}
+
+string symbolTableFileOf(const string &path)
+{
+	return path.substr(0, path.size() - 5) + ".symtab";
+}
+
+bool readWholeFile(const string &path, string *contents)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == nullptr)
+		return false;
+	contents->clear();
+	char buffer[1 << 16];
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		contents->append(buffer, count);
+	}
+	fclose(file);
+	return true;
+}
+
+// Writes the symbol table of path to <name>.symtab and its report to
+// standard output under the limits of settings; previous holds the parses
+// of the last analysis of path
+WatchedFile analyzeFile(const Analysis *settings, const string &path, string input, ParseCache *previous)
+{
+	Analysis analysis = analysisOf(settings, path, symbolTableFileOf(path));
+
+	cout << "== " << path << endl;
+	startClock(&analysis.limits);
+	ALLOCATION_PHASE(PHASE_LEXER);
+	vector<Token> tokens = tokenize<ReportLexer>(&analysis, input);
+	ALLOCATION_PHASE(PHASE_OUTPUT);
+	printDiagnostics(&analysis, input, cout, stdout);
+	printTokens(&analysis, tokens, true);
+	ALLOCATION_PHASE(PHASE_PARSER);
+	ParseCache parses = {{}, {}, {}, {}, {}, 0, 0};
+	parseIncrementally(&analysis, &tokens, previous, &parses);
+	vector<Statement> &statements = parses.statements;
+	ALLOCATION_PHASE(PHASE_SEMANTIC);
+	analyze(&tokens, &statements);
+	ALLOCATION_PHASE(PHASE_OUTPUT);
+	printSyntax(statements);
+
+	WatchedFile result = {move(input), tokens.size(), statements.size(), 0, {}};
+	for (const Statement &statement : statements)
+	{
+		if (!statement.validity)
+			result.invalid++;
+	}
+	result.parses = move(parses);
+	return result;
+}
+
+// Returns false when the file could not be read or did not change
+bool reanalyze(const Analysis *settings, unordered_map<string, WatchedFile> *files, const string &path)
+{
+	string input;
+	if (!readWholeFile(path, &input))
+		return false;
+	auto found = files->find(path);
+	if (found != files->end() && found->second.input == input)
+		return false;
+
+	ParseCache none = {{}, {}, {}, {}, {}, 0, 0};
+	(*files)[path] = analyzeFile(settings, path, move(input), found != files->end() ? &found->second.parses : &none);
+	return true;
+}
+
+void forget(unordered_map<string, WatchedFile> *files, const string &path)
+{
+	if (files->erase(path) > 0)
+	{
+		remove(symbolTableFileOf(path).c_str());
+		cout << "== " << path << " removed" << endl;
+	}
+}
+
+#ifdef __linux__
+// Watches directory and the directories below it; wd maps back to paths
+void watchDirectory(int fd, const string &directory, unordered_map<int, string> *directories, vector<string> *found)
+{
+	int wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE | IN_DELETE_SELF);
+	if (wd < 0)
+	{
+		cout << "Error: cannot watch " << directory << endl;
+		return;
+	}
+	(*directories)[wd] = directory;
+
+	error_code error;
+	for (const filesystem::directory_entry &entry : filesystem::directory_iterator(directory, error))
+	{
+		string path = entry.path().string();
+		if (entry.is_directory(error))
+			watchDirectory(fd, path, directories, found);
+		else if (isWikaFile(path))
+			found->push_back(path);
+	}
+}
+
+int watchTree(const Analysis *settings, const string &root)
+{
+	int fd = inotify_init1(IN_CLOEXEC);
+	if (fd < 0)
+	{
+		cout << "Error: inotify is not available" << endl;
+		return 1;
+	}
+
+	unordered_map<int, string> directories;
+	unordered_map<string, WatchedFile> files;
+	vector<string> found;
+	watchDirectory(fd, root, &directories, &found);
+	for (const string &path : found)
+	{
+		reanalyze(settings, &files, path);
+	}
+	cout << ">> Watching " << files.size() << " files under " << root << endl;
+
+	alignas(struct inotify_event) char buffer[1 << 16];
+	while (!directories.empty())
+	{
+		// block for the first event, then gather until the tree is quiet
+		vector<string> changed;
+		vector<string> removed;
+		int timeout = -1;
+		struct pollfd ready = {fd, POLLIN, 0};
+		while (poll(&ready, 1, timeout) > 0)
+		{
+			ssize_t length = read(fd, buffer, sizeof(buffer));
+			if (length <= 0)
+				break;
+			for (char *at = buffer; at < buffer + length;)
+			{
+				struct inotify_event *event = (struct inotify_event *)at;
+				at += sizeof(struct inotify_event) + event->len;
+				auto directory = directories.find(event->wd);
+				if (directory == directories.end())
+					continue;
+				if (event->mask & (IN_DELETE_SELF | IN_IGNORED))
+				{
+					directories.erase(directory);
+					continue;
+				}
+				string path = directory->second + "/" + event->name;
+				if (event->mask & IN_ISDIR)
+				{
+					if (event->mask & (IN_CREATE | IN_MOVED_TO))
+						watchDirectory(fd, path, &directories, &changed);
+				}
+				else if (!isWikaFile(path))
+					continue;
+				else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+					changed.push_back(path);
+				else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+					removed.push_back(path);
+			}
+			timeout = watchQuietMs;
+		}
+
+		auto start = chrono::steady_clock::now();
+		sort(changed.begin(), changed.end());
+		changed.erase(unique(changed.begin(), changed.end()), changed.end());
+		int updated = 0;
+		size_t reused = 0, statements = 0;
+		for (const string &path : removed)
+		{
+			if (!binary_search(changed.begin(), changed.end(), path))
+				forget(&files, path);
+		}
+		for (const string &path : changed)
+		{
+			if (!reanalyze(settings, &files, path))
+				continue;
+			const ParseCache &parses = files[path].parses;
+			updated++;
+			reused += parses.reused;
+			statements += parses.reused + parses.parsed;
+		}
+		if (updated > 0)
+		{
+			double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			cout << ">> Re-analyzed " << updated << " of " << files.size() << " files in " << ms << " ms, reusing "
+				 << reused << " of " << statements << " statements" << endl;
+		}
+	}
+	close(fd);
+	return 0;
+}
+#else
+int watchTree(const Analysis *settings, const string &root)
+{
+	cout << "--watch needs inotify, which is only available on Linux" << endl;
+	return 1;
+}
+#endif
+
+/*============================ BATCH LOADING ================================================================*/
+
+// --batch dir: analyzes every .wika file under dir once and writes each
+// symbol table next to its file as <name>.symtab, like --watch. A loader
+// thread reads files ahead of the analyzer: on Linux through io_uring, so
+// the opens, stats and reads of many files reach the kernel in a few
+// system calls, elsewhere (or when io_uring is unavailable) through a pool
+// of threads calling pread(). At most batchWindow files wait in memory.
+struct LoadedFile
+{
+	string path;
+	string input;
+	bool ready;
+	bool ok;
+};
+
+struct BatchQueue
+{
+	vector<LoadedFile> files;
+	size_t analyzed; // files before this one have been handed to the analyzer
+	const char *loader;
+	mutex lock;
+	condition_variable changed;
+};
+
+const size_t batchWindow = 256;
+const int batchReaders = 8;
+
+// Blocks until the analyzer is close enough for files[index] to be loaded
+void waitForRoom(BatchQueue *queue, size_t index)
+{
+	unique_lock<mutex> held(queue->lock);
+	queue->changed.wait(held, [&] { return index < queue->analyzed + batchWindow; });
+}
+
+bool hasRoom(BatchQueue *queue, size_t index)
+{
+	lock_guard<mutex> held(queue->lock);
+	return index < queue->analyzed + batchWindow;
+}
+
+void deliver(BatchQueue *queue, size_t index, bool ok)
+{
+	lock_guard<mutex> held(queue->lock);
+	queue->files[index].ready = true;
+	queue->files[index].ok = ok;
+	queue->changed.notify_all();
+}
+
+#ifdef _WIN32
+bool preadWholeFile(const string &path, string *contents)
+{
+	return readWholeFile(path, contents);
+}
+#else
+bool preadWholeFile(const string &path, string *contents)
+{
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	struct stat info;
+	bool ok = fstat(fd, &info) == 0;
+	size_t done = 0;
+	contents->resize(ok ? info.st_size : 0);
+	while (ok && done < contents->size())
+	{
+		ssize_t count = pread(fd, &(*contents)[done], contents->size() - done, done);
+		if (count <= 0)
+		{
+			ok = count == 0;
+			break;
+		}
+		done += count;
+	}
+	contents->resize(done);
+	close(fd);
+	return ok;
+}
+#endif
+
+void loadWithThreads(BatchQueue *queue)
+{
+	queue->loader = "pread";
+	atomic<size_t> next(0);
+	int readers = min((size_t)batchReaders, max((size_t)1, queue->files.size()));
+	parallelFor(readers, [&](int t) {
+		size_t index;
+		while ((index = next++) < queue->files.size())
+		{
+			waitForRoom(queue, index);
+			LoadedFile &file = queue->files[index];
+			deliver(queue, index, preadWholeFile(file.path, &file.input));
+		}
+	});
+}
+
+#ifdef __linux__
+struct Uring
+{
+	int fd;
+	unsigned entries;
+	unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+	unsigned *cqHead, *cqTail, *cqMask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sqRing, *cqRing;
+	size_t sqRingSize, cqRingSize;
+	unsigned queued; // entries written since the last io_uring_enter
+};
+
+enum UringStep
+{
+	STEP_OPEN,
+	STEP_STAT,
+	STEP_READ,
+	STEP_CLOSE
+};
+
+// What the ring knows about files[index] while it is being loaded; each of
+// the batchWindow slots is reused by every batchWindow-th file
+struct UringFile
+{
+	int fd;
+	struct statx stat;
+	int waiting; // the open and stat both have to finish before reading
+	size_t done;
+	bool failed;
+	int pending; // requests other than the close the kernel has not completed
+};
+
+bool openUring(Uring *ring, unsigned entries)
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd < 0)
+		return false;
+
+	// the loader needs openat, statx, read and close (Linux 5.6)
+	vector<char> probeBuffer(sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op), 0);
+	struct io_uring_probe *probe = (struct io_uring_probe *)probeBuffer.data();
+	bool supported = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+	for (int op : {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE})
+	{
+		supported = supported && op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+	}
+
+	ring->entries = params.sq_entries;
+	ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single)
+		ring->sqRingSize = ring->cqRingSize = max(ring->sqRingSize, ring->cqRingSize);
+	ring->sqRing = mmap(nullptr, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	ring->cqRing = single ? ring->sqRing : mmap(nullptr, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = (struct io_uring_sqe *)mmap(nullptr, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (!supported || ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED)
+	{
+		close(ring->fd);
+		return false;
+	}
+
+	char *sq = (char *)ring->sqRing;
+	char *cq = (char *)ring->cqRing;
+	ring->sqHead = (unsigned *)(sq + params.sq_off.head);
+	ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+	ring->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+	ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+	ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+	ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+	ring->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+	ring->queued = 0;
+	return true;
+}
+
+void closeUring(Uring *ring)
+{
+	munmap(ring->sqes, ring->entries * sizeof(struct io_uring_sqe));
+	if (ring->cqRing != ring->sqRing)
+		munmap(ring->cqRing, ring->cqRingSize);
+	munmap(ring->sqRing, ring->sqRingSize);
+	close(ring->fd);
+}
+
+// The caller keeps the number of requests in flight below ring->entries,
+// so the submission queue always has room
+struct io_uring_sqe *queueRequest(Uring *ring, int opcode, size_t index, UringStep step)
+{
+	unsigned tail = *ring->sqTail;
+	unsigned slot = tail & *ring->sqMask;
+	struct io_uring_sqe *sqe = &ring->sqes[slot];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->user_data = (uint64_t)index << 2 | step;
+	ring->sqArray[slot] = slot;
+	__atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+	ring->queued++;
+	return sqe;
+}
+
+void queueRead(Uring *ring, LoadedFile *file, UringFile *state, size_t index)
+{
+	struct io_uring_sqe *sqe = queueRequest(ring, IORING_OP_READ, index, STEP_READ);
+	sqe->fd = state->fd;
+	sqe->addr = (uint64_t)(file->input.data() + state->done);
+	sqe->len = min(file->input.size() - state->done, (size_t)UINT_MAX);
+	sqe->off = state->done;
+	state->pending++;
+}
+
+void queueClose(Uring *ring, UringFile *state, size_t index)
+{
+	struct io_uring_sqe *sqe = queueRequest(ring, IORING_OP_CLOSE, index, STEP_CLOSE);
+	sqe->fd = state->fd;
+}
+
+// Once io_uring_enter has failed, a file that was not read completely is
+// left to the pread() fallback; only its descriptor is closed here, when the
+// kernel no longer has requests that write into the file or its state
+void abandonFile(UringFile *state)
+{
+	if (state->pending > 0)
+		return;
+	if (state->fd >= 0)
+		close(state->fd);
+	state->fd = -1;
+}
+
+// Takes back the entries the kernel has not consumed after io_uring_enter
+// failed; they will never complete
+void dropUnsubmitted(Uring *ring, vector<UringFile> *states, unsigned *inFlight)
+{
+	unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+	for (unsigned tail = *ring->sqTail; tail != head; tail--)
+	{
+		struct io_uring_sqe *sqe = &ring->sqes[ring->sqArray[(tail - 1) & *ring->sqMask]];
+		UringFile *state = &(*states)[(sqe->user_data >> 2) % batchWindow];
+		(*inFlight)--;
+		if ((sqe->user_data & 3) == STEP_CLOSE)
+		{
+			close(sqe->fd);
+			continue;
+		}
+		state->pending--;
+		abandonFile(state);
+	}
+	__atomic_store_n(ring->sqTail, head, __ATOMIC_RELEASE);
+	ring->queued = 0;
+}
+
+bool loadWithUring(BatchQueue *queue)
+{
+	Uring ring;
+	if (!openUring(&ring, 2 * batchWindow))
+		return false;
+	queue->loader = "io_uring";
+
+	vector<UringFile> states(batchWindow);
+	size_t count = queue->files.size();
+	size_t next = 0;      // the next file to open
+	size_t delivered = 0; // files handed to the analyzer
+	unsigned inFlight = 0;
+	// set when io_uring_enter fails: nothing new is queued, and the requests
+	// already in flight are reaped before the ring is closed, so the kernel
+	// is done with every buffer the pread() fallback is about to reuse
+	bool stopped = false;
+	while (stopped ? inFlight > 0 : delivered < count || inFlight > 0)
+	{
+		// each new file takes two entries, and each of those is replaced by
+		// at most one read or close when it completes
+		while (!stopped && next < count && inFlight + 2 <= ring.entries && hasRoom(queue, next))
+		{
+			UringFile &state = states[next % batchWindow];
+			state = {-1, {}, 2, 0, false, 2};
+			const char *path = queue->files[next].path.c_str();
+			struct io_uring_sqe *sqe = queueRequest(&ring, IORING_OP_OPENAT, next, STEP_OPEN);
+			sqe->fd = AT_FDCWD;
+			sqe->addr = (uint64_t)path;
+			sqe->open_flags = O_RDONLY | O_CLOEXEC;
+			sqe = queueRequest(&ring, IORING_OP_STATX, next, STEP_STAT);
+			sqe->fd = AT_FDCWD;
+			sqe->addr = (uint64_t)path;
+			sqe->len = STATX_SIZE;
+			sqe->off = (uint64_t)&state.stat;
+			inFlight += 2;
+			next++;
+		}
+		if (inFlight == 0)
+		{
+			waitForRoom(queue, next);
+			continue;
+		}
+
+		if (syscall(__NR_io_uring_enter, ring.fd, ring.queued, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (!stopped)
+			{
+				stopped = true;
+				dropUnsubmitted(&ring, &states, &inFlight);
+				continue;
+			}
+			// completions are still posted to the ring without io_uring_enter
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		ring.queued = 0;
+
+		unsigned head = *ring.cqHead;
+		unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++)
+		{
+			struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cqMask];
+			size_t index = cqe->user_data >> 2;
+			UringStep step = (UringStep)(cqe->user_data & 3);
+			int result = cqe->res;
+			LoadedFile &file = queue->files[index];
+			UringFile &state = states[index % batchWindow];
+			inFlight--;
+			if (step == STEP_CLOSE)
+				continue;
+			state.pending--;
+
+			bool finished = false;
+			if (step == STEP_OPEN || step == STEP_STAT)
+			{
+				if (step == STEP_OPEN && result >= 0)
+					state.fd = result;
+				state.failed = state.failed || result < 0;
+				if (--state.waiting > 0)
+				{
+					// the other one may have been dropped
+					if (stopped)
+						abandonFile(&state);
+					continue;
+				}
+				if (!state.failed)
+					file.input.resize(state.stat.stx_size);
+				finished = state.failed || file.input.empty();
+			}
+			else if (result <= 0)
+			{
+				// a short file ends early; an error drops the file
+				state.failed = result < 0;
+				file.input.resize(state.done);
+				finished = true;
+			}
+			else
+			{
+				state.done += result;
+				finished = state.done == file.input.size();
+			}
+
+			if (!finished && stopped)
+			{
+				abandonFile(&state);
+				continue;
+			}
+			if (!finished)
+			{
+				queueRead(&ring, &file, &state, index);
+				inFlight++;
+				continue;
+			}
+			if (state.fd >= 0 && stopped)
+			{
+				close(state.fd);
+			}
+			else if (state.fd >= 0)
+			{
+				queueClose(&ring, &state, index);
+				inFlight++;
+			}
+			deliver(queue, index, !state.failed);
+			delivered++;
+		}
+		__atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+	}
+	closeUring(&ring);
+
+	// if the ring failed part way, the remaining files are read with pread()
+	for (size_t index = 0; index < count; index++)
+	{
+		if (queue->files[index].ready)
+			continue;
+		waitForRoom(queue, index);
+		LoadedFile &file = queue->files[index];
+		deliver(queue, index, preadWholeFile(file.path, &file.input));
+	}
+	return true;
+}
+#else
+bool loadWithUring(BatchQueue *queue)
+{
+	return false;
+}
+#endif
+
+// --cold: drops the files from the page cache so they are read from disk
+void evictFromPageCache(const vector<string> &paths)
+{
+#if defined(POSIX_FADV_DONTNEED)
+	for (const string &path : paths)
+	{
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			continue;
+		fdatasync(fd);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+#else
+	cout << "--cold is not supported on this system; the page cache is left as is" << endl;
+#endif
+}
+
+int batchAnalyze(const Analysis *settings, const string &root, bool cold)
+{
+	vector<string> paths;
+	error_code error;
+	for (filesystem::recursive_directory_iterator entry(root, error), end; !error && entry != end; entry.increment(error))
+	{
+		string path = entry->path().string();
+		if (isWikaFile(path) && !entry->is_directory(error))
+			paths.push_back(path);
+	}
+	if (error)
+	{
+		cout << "Error: cannot read " << root << endl;
+		return 1;
+	}
+	sort(paths.begin(), paths.end());
+	if (cold)
+		evictFromPageCache(paths);
+
+	BatchQueue queue;
+	queue.files.resize(paths.size());
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		queue.files[i] = {paths[i], "", false, false};
+	}
+	queue.analyzed = 0;
+	queue.loader = "";
+
+	auto start = chrono::steady_clock::now();
+	thread loader([&] {
+		if (!loadWithUring(&queue))
+			loadWithThreads(&queue);
+	});
+	size_t bytes = 0;
+	size_t failed = 0;
+	ParseCache none = {{}, {}, {}, {}, {}, 0, 0};
+	for (size_t i = 0; i < queue.files.size(); i++)
+	{
+		LoadedFile &file = queue.files[i];
+		{
+			unique_lock<mutex> held(queue.lock);
+			queue.changed.wait(held, [&] { return file.ready; });
+		}
+		if (file.ok)
+		{
+			bytes += file.input.size();
+			analyzeFile(settings, file.path, move(file.input), &none);
+		}
+		else
+		{
+			cout << "Error: cannot read " << file.path << endl;
+			failed++;
+		}
+		string().swap(file.input);
+		lock_guard<mutex> held(queue.lock);
+		queue.analyzed = i + 1;
+		queue.changed.notify_all();
+	}
+	loader.join();
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	cout << ">> Analyzed " << paths.size() - failed << " files (" << bytes << " bytes) in " << seconds * 1000 << " ms with "
+		 << queue.loader << " on a " << (cold ? "cold" : "warm") << " page cache: "
+		 << (size_t)((paths.size() - failed) / max(seconds, 1e-9)) << " files/s" << endl;
+	return failed == 0 ? 0 : 1;
+}
+
+/*============================ REPL =========================================================================*/
+
+// --repl: reads WiKa from standard input one line at a time and reports
+// each statement as soon as its line is entered. Declared names, open
+// blocks and an unterminated /* comment carry over to the next line; the
+// line and token buffers are reused, so a line costs only its own tokens.
+struct Repl
+{
+	Analysis analysis;
+	SymbolTable table;
+	bool inComment;
+	string line;
+	string buffer;
+	vector<Token> tokens;
+};
+
+void printReplPrompt(Repl *repl)
+{
+	if (repl->inComment)
+		cout << "wika /*> " << flush;
+	else
+		cout << "wika" << string(repl->table.marks.size(), '{') << "> " << flush;
+}
+
+void replLine(Repl *repl)
+{
+	string_view text = repl->line;
+	if (repl->inComment)
+	{
+		size_t end = text.find("*/");
+		if (end == string_view::npos)
+			return;
+		text.remove_prefix(end + 2);
+		repl->inComment = false;
+	}
+	repl->buffer.assign(text);
+	repl->buffer += '\n';
+	repl->tokens.clear();
+	repl->analysis.diagnostics.records.clear();
+	repl->analysis.diagnostics.suppressed = 0;
+	ALLOCATION_PHASE(PHASE_LEXER);
+	tokenizeInto<SyntaxLexer>(&repl->analysis, repl->buffer, &repl->tokens);
+	ALLOCATION_PHASE(PHASE_OUTPUT);
+
+	// an unterminated comment is not an error here: it continues on the next lines
+	for (const Diagnostic &diagnostic : repl->analysis.diagnostics.records)
+	{
+		if (diagnostic.code == DIAG_UNTERMINATED_COMMENT)
+		{
+			repl->inComment = true;
+			continue;
+		}
+		cout << "  error: " << diagnosticMessages[diagnostic.code];
+		if (diagnostic.code == DIAG_UNRECOGNIZED_TOKEN || diagnostic.code == DIAG_NUMBER_OUT_OF_RANGE)
+			cout << " '" << repl->buffer.substr(diagnostic.offset, diagnostic.length) << "'";
+		cout << " at column " << columnAt(&repl->analysis.lines, diagnostic.offset) << endl;
+	}
+
+	ALLOCATION_PHASE(PHASE_PARSER);
+	parseInto(&repl->analysis, &repl->tokens, [&](Statement &statement) {
+		ALLOCATION_PHASE(PHASE_SEMANTIC);
+		analyzeStatement(&repl->table, &repl->tokens, &statement);
+		ALLOCATION_PHASE(PHASE_OUTPUT);
+		cout << "  " << statement.syntax << "\t" << (statement.validity ? "Valid" : "Invalid");
+		if (!statement.message.empty())
+			cout << "\t" << statement.message;
+		cout << endl;
+		ALLOCATION_PHASE(PHASE_PARSER);
+	});
+}
+
+int runRepl(const Analysis *settings)
+{
+#ifdef _WIN32
+	bool interactive = _isatty(_fileno(stdin));
+#else
+	bool interactive = isatty(fileno(stdin));
+#endif
+	Repl repl;
+	repl.analysis = analysisOf(settings, "", "");
+	initSymbolTable(&repl.table);
+	repl.inComment = false;
+	if (interactive)
+	{
+		cout << "WiKa REPL: enter statements one line at a time, end with Ctrl-D" << endl;
+		printReplPrompt(&repl);
+	}
+	while (getline(cin, repl.line))
+	{
+		replLine(&repl);
+		if (interactive)
+			printReplPrompt(&repl);
+	}
+	if (interactive)
+		cout << endl;
+	return 0;
+}
+
+/*============================ IDENTIFIER INDEX =============================================================*/
+
+// --index dir writes dir/wika.index, which maps every identifier in the
+// .wika files under dir to where it occurs: file, line, token index (the
+// INDEX column of the symbol table) and whether it is declared there by
+// parseDeclaration() or used. Running it again lexes only the files whose
+// size or modification time changed. --query dir name maps the index and
+// looks name up in its hash table without reading the rest of the file.
+//
+// The file starts with the magic "WKI2" and five u32 counts: files, names,
+// slots, occurrences and string bytes. Then come fixed-width tables of
+// little-endian u32 fields, so each entry is found by its position:
+//   file:       path offset, path length, mtime low, mtime high, size low, size high
+//   name:       hash low, name offset, name length, first occurrence, occurrences
+//   slot:       1 + index of a name, or 0 when empty; slots is a power of two
+//   occurrence: file, line, token, role
+// and finally the paths and names, which the offsets point into.
+enum OccurrenceRole
+{
+	ROLE_USE,
+	ROLE_DECLARATION
+};
+
+struct Occurrence
+{
+	uint32_t file;
+	uint32_t line;
+	uint32_t token;
+	uint32_t role;
+};
+
+struct IndexedFile
+{
+	string path;
+	uint64_t mtime;
+	uint64_t size;
+};
+
+const int indexHeaderSize = 24;
+const int indexFileSize = 24;
+const int indexNameSize = 20;
+const int indexOccurrenceSize = 16;
+
+string indexFileOf(const string &root)
+{
+	return root + "/wika.index";
+}
+
+uint32_t getU32(const unsigned char *bytes)
+{
+	return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+// A read-only view of an index file, mapped where mmap() is available
+struct IdentifierIndex
+{
+	const unsigned char *data;
+	size_t size;
+	uint32_t files, names, slots, occurrences, strings;
+	string contents; // the whole file where it cannot be mapped
+};
+
+const unsigned char *indexFileEntry(IdentifierIndex *index, uint32_t file)
+{
+	return index->data + indexHeaderSize + (size_t)file * indexFileSize;
+}
+
+const unsigned char *indexNameEntry(IdentifierIndex *index, uint32_t name)
+{
+	return indexFileEntry(index, index->files) + (size_t)name * indexNameSize;
+}
+
+const unsigned char *indexOccurrenceEntry(IdentifierIndex *index, uint32_t occurrence)
+{
+	return indexNameEntry(index, index->names) + (size_t)index->slots * 4 + (size_t)occurrence * indexOccurrenceSize;
+}
+
+string_view indexString(IdentifierIndex *index, uint32_t offset, uint32_t length)
+{
+	const unsigned char *strings = indexOccurrenceEntry(index, index->occurrences);
+	return string_view((const char *)strings + offset, length);
+}
+
+// The counts in the header are checked against the file size when it is
+// opened. The offsets and ids inside the entries are checked as they are
+// read, so a lookup still touches only the entries it needs. A truncated or
+// damaged index fails these checks and is rebuilt by --index.
+bool indexStringFits(IdentifierIndex *index, uint32_t offset, uint32_t length)
+{
+	return (uint64_t)offset + length <= index->strings;
+}
+
+// The name's text and its run of occurrences lie inside the index
+bool indexNameFits(IdentifierIndex *index, const unsigned char *named)
+{
+	return indexStringFits(index, getU32(named + 4), getU32(named + 8)) &&
+		   (uint64_t)getU32(named + 12) + getU32(named + 16) <= index->occurrences;
+}
+
+bool openIdentifierIndex(const string &path, IdentifierIndex *index)
+{
+	index->data = nullptr;
+	index->size = 0;
+#ifdef _WIN32
+	if (!readWholeFile(path, &index->contents))
+		return false;
+	index->data = (const unsigned char *)index->contents.data();
+	index->size = index->contents.size();
+#else
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	struct stat info;
+	if (fd < 0 || fstat(fd, &info) != 0 || info.st_size < indexHeaderSize)
+	{
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+	void *map = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+	index->data = (const unsigned char *)map;
+	index->size = info.st_size;
+#endif
+	if (index->size < indexHeaderSize || memcmp(index->data, "WKI2", 4) != 0)
+		return false;
+	index->files = getU32(index->data + 4);
+	index->names = getU32(index->data + 8);
+	index->slots = getU32(index->data + 12);
+	index->occurrences = getU32(index->data + 16);
+	index->strings = getU32(index->data + 20);
+	size_t expected = indexHeaderSize + (size_t)index->files * indexFileSize + (size_t)index->names * indexNameSize +
+					  (size_t)index->slots * 4 + (size_t)index->occurrences * indexOccurrenceSize + index->strings;
+	return expected == index->size && (index->slots & (index->slots - 1)) == 0;
+}
+
+void closeIdentifierIndex(IdentifierIndex *index)
+{
+#ifndef _WIN32
+	if (index->data != nullptr)
+		munmap((void *)index->data, index->size);
+#endif
+	index->data = nullptr;
+}
+
+IndexedFile indexedFileAt(IdentifierIndex *index, uint32_t file)
+{
+	const unsigned char *entry = indexFileEntry(index, file);
+	IndexedFile result;
+	result.path = string(indexString(index, getU32(entry), getU32(entry + 4)));
+	result.mtime = getU32(entry + 8) | (uint64_t)getU32(entry + 12) << 32;
+	result.size = getU32(entry + 16) | (uint64_t)getU32(entry + 20) << 32;
+	return result;
+}
+
+// Index of name in the names table, -1 when it does not occur, or -2 when
+// the index is damaged
+long long findIndexedName(IdentifierIndex *index, const string &name)
+{
+	if (index->slots == 0)
+		return -1;
+	uint64_t hash = hashName(name);
+	uint32_t mask = index->slots - 1;
+	const unsigned char *slots = indexNameEntry(index, index->names);
+	uint32_t slot = hash & mask;
+	for (uint32_t probe = 0; probe < index->slots; probe++, slot = (slot + 1) & mask)
+	{
+		uint32_t entry = getU32(slots + (size_t)slot * 4);
+		if (entry == 0)
+			return -1;
+		if (entry > index->names)
+			return -2;
+		const unsigned char *named = indexNameEntry(index, entry - 1);
+		if (!indexNameFits(index, named))
+			return -2;
+		if (getU32(named) == (uint32_t)hash && indexString(index, getU32(named + 4), getU32(named + 8)) == name)
+			return entry - 1;
+	}
+	// a table with no empty slot was not written by writeIdentifierIndex()
+	return -2;
+}
+
+bool statFile(const string &path, IndexedFile *file)
+{
+	error_code error;
+	file->path = path;
+	file->size = filesystem::file_size(path, error);
+	if (error)
+		return false;
+	file->mtime = filesystem::last_write_time(path, error).time_since_epoch().count();
+	return !error;
+}
+
+// Adds the identifiers of one file, lexed and parsed as for the syntax report
+void indexIdentifiers(Analysis *analysis, const string &input, uint32_t file, unordered_map<string, vector<Occurrence>> *names)
+{
+	ALLOCATION_PHASE(PHASE_LEXER);
+	vector<Token> tokens = tokenize<ReportLexer>(analysis, input);
+	ALLOCATION_PHASE(PHASE_OUTPUT);
+	for (size_t i = 0; i < tokens.size(); i++)
+	{
+		if (tokens[i].type == IDENTIFIER)
+		{
+			// a type keyword is only ever followed by the name it declares,
+			// whether the declaration is a statement or a loop header
+			bool declared = i > 0 && tokens[i - 1].type == DATA_TYPE;
+			uint32_t role = declared ? ROLE_DECLARATION : ROLE_USE;
+			(*names)[tokens[i].value].push_back({file, (uint32_t)lineOf(analysis, tokens[i]), (uint32_t)i, role});
+		}
+	}
+}
+
+bool writeIdentifierIndex(const string &path, const vector<IndexedFile> &files, unordered_map<string, vector<Occurrence>> *names)
+{
+	vector<pair<const string *, vector<Occurrence> *>> sorted;
+	for (auto &entry : *names)
+	{
+		sort(entry.second.begin(), entry.second.end(), [](const Occurrence &a, const Occurrence &b) {
+			return a.file != b.file ? a.file < b.file : a.token < b.token;
+		});
+		sorted.push_back({&entry.first, &entry.second});
+	}
+	sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) { return *a.first < *b.first; });
+
+	uint32_t slots = 64;
+	while (slots < sorted.size() * 2)
+	{
+		slots *= 2;
+	}
+	vector<uint32_t> table(slots, 0);
+	size_t occurrences = 0;
+	uint32_t strings = 0;
+	for (const IndexedFile &file : files)
+	{
+		strings += file.path.size();
+	}
+	for (size_t n = 0; n < sorted.size(); n++)
+	{
+		uint32_t slot = hashName(*sorted[n].first) & (slots - 1);
+		while (table[slot] != 0)
+		{
+			slot = (slot + 1) & (slots - 1);
+		}
+		table[slot] = n + 1;
+		occurrences += sorted[n].second->size();
+		strings += sorted[n].first->size();
+	}
+
+	string temporary = path + ".tmp";
+	FILE *out = fopen(temporary.c_str(), "wb");
+	if (out == nullptr)
+		return false;
+	Encoder e;
+	e.file = out;
+	e.used = 0;
+	e.failed = false;
+	putBytes(&e, "WKI2", 4);
+	for (uint32_t count : {(uint32_t)files.size(), (uint32_t)sorted.size(), slots, (uint32_t)occurrences, strings})
+	{
+		putU32(&e, count);
+	}
+	uint32_t offset = 0;
+	for (const IndexedFile &file : files)
+	{
+		for (uint32_t field : {offset, (uint32_t)file.path.size(), (uint32_t)file.mtime, (uint32_t)(file.mtime >> 32),
+							   (uint32_t)file.size, (uint32_t)(file.size >> 32)})
+		{
+			putU32(&e, field);
+		}
+		offset += file.path.size();
+	}
+	uint32_t first = 0;
+	for (const auto &name : sorted)
+	{
+		for (uint32_t field : {(uint32_t)hashName(*name.first), offset, (uint32_t)name.first->size(), first, (uint32_t)name.second->size()})
+		{
+			putU32(&e, field);
+		}
+		offset += name.first->size();
+		first += name.second->size();
+	}
+	for (uint32_t entry : table)
+	{
+		putU32(&e, entry);
+	}
+	for (const auto &name : sorted)
+	{
+		for (const Occurrence &occurrence : *name.second)
+		{
+			for (uint32_t field : {occurrence.file, occurrence.line, occurrence.token, occurrence.role})
+			{
+				putU32(&e, field);
+			}
+		}
+	}
+	for (const IndexedFile &file : files)
+	{
+		putText(&e, file.path);
+	}
+	for (const auto &name : sorted)
+	{
+		putText(&e, *name.first);
+	}
+	flushEncoder(&e);
+	bool ok = fclose(out) == 0 && !e.failed;
+	// replace the old index only once the new one is complete
+	return ok && rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+int buildIdentifierIndex(const Analysis *settings, const string &root)
+{
+	auto start = chrono::steady_clock::now();
+	vector<IndexedFile> files;
+	error_code error;
+	for (filesystem::recursive_directory_iterator entry(root, error), end; !error && entry != end; entry.increment(error))
+	{
+		IndexedFile file;
+		string path = entry->path().string();
+		if (isWikaFile(path) && !entry->is_directory(error) && statFile(path, &file))
+			files.push_back(file);
+	}
+	if (error)
 	{
-		Statement statement = statements[i];
+		cout << "Error: cannot read " << root << endl;
+		return 1;
+	}
+	sort(files.begin(), files.end(), [](const IndexedFile &a, const IndexedFile &b) { return a.path < b.path; });
 
-		cout << statement.line << "\t";
-		cout << statement.syntax << "\t\t\t\t\t";
-		if (statement.validity)
+	// occurrences in files that did not change are copied from the old index
+	unordered_map<string, vector<Occurrence>> names;
+	vector<char> current(files.size(), 0);
+	IdentifierIndex old;
+	string indexPath = indexFileOf(root);
+	if (openIdentifierIndex(indexPath, &old))
+	{
+		unordered_map<string, uint32_t> fileIds;
+		for (uint32_t f = 0; f < files.size(); f++)
 		{
-			cout << "Valid";
+			fileIds[files[f].path] = f;
 		}
-		else
+		vector<long long> renumbered(old.files, -1);
+		bool damaged = false;
+		for (uint32_t f = 0; f < old.files; f++)
+		{
+			const unsigned char *entry = indexFileEntry(&old, f);
+			damaged = !indexStringFits(&old, getU32(entry), getU32(entry + 4));
+			if (damaged)
+				break;
+			IndexedFile indexed = indexedFileAt(&old, f);
+			auto found = fileIds.find(indexed.path);
+			if (found != fileIds.end() && files[found->second].mtime == indexed.mtime && files[found->second].size == indexed.size)
+			{
+				renumbered[f] = found->second;
+				current[found->second] = 1;
+			}
+		}
+		for (uint32_t n = 0; n < old.names && !damaged; n++)
+		{
+			const unsigned char *named = indexNameEntry(&old, n);
+			vector<Occurrence> *occurrences = nullptr;
+			damaged = !indexNameFits(&old, named);
+			for (uint32_t o = getU32(named + 12); !damaged && o < getU32(named + 12) + getU32(named + 16); o++)
+			{
+				const unsigned char *entry = indexOccurrenceEntry(&old, o);
+				damaged = getU32(entry) >= old.files;
+				if (damaged)
+					break;
+				long long file = renumbered[getU32(entry)];
+				if (file < 0)
+					continue;
+				if (occurrences == nullptr)
+					occurrences = &names[string(indexString(&old, getU32(named + 4), getU32(named + 8)))];
+				occurrences->push_back({(uint32_t)file, getU32(entry + 4), getU32(entry + 8), getU32(entry + 12)});
+			}
+		}
+		// nothing from a damaged index is kept; every file is lexed again
+		if (damaged)
 		{
-			cout << "Invalid";
+			cout << ">> " << indexPath << " is damaged, rebuilding it" << endl;
+			names.clear();
+			fill(current.begin(), current.end(), 0);
 		}
-			cout << "\t\t\t";
-		cout << statement.message << endl;
 	}
+	closeIdentifierIndex(&old);
+
+	int lexed = 0;
+	string input;
+	for (uint32_t f = 0; f < files.size(); f++)
+	{
+		if (current[f])
+			continue;
+		if (!readWholeFile(files[f].path, &input))
+		{
+			cout << "Error: cannot read " << files[f].path << endl;
+			continue;
+		}
+		Analysis analysis = analysisOf(settings, files[f].path, "");
+		indexIdentifiers(&analysis, input, f, &names);
+		lexed++;
+	}
+
+	if (!writeIdentifierIndex(indexPath, files, &names))
+	{
+		cout << "Error: cannot write " << indexPath << endl;
+		return 1;
+	}
+	size_t occurrences = 0;
+	for (const auto &entry : names)
+	{
+		occurrences += entry.second.size();
+	}
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	cout << ">> Indexed " << files.size() << " files (" << lexed << " lexed) in " << ms << " ms: "
+		 << names.size() << " identifiers, " << occurrences << " occurrences" << endl;
+	return 0;
 }
 
-int main()
+int queryIdentifierIndex(const string &root, const string &name)
 {
+	IdentifierIndex index;
+	if (!openIdentifierIndex(indexFileOf(root), &index))
+	{
+		closeIdentifierIndex(&index);
+		cout << "Error: no index under " << root << ", run --index " << root << " first" << endl;
+		return 1;
+	}
+	auto start = chrono::steady_clock::now();
+	long long found = findIndexedName(&index, name);
+	double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+	if (found == -2)
+	{
+		cout << "Error: the index under " << root << " is damaged, run --index " << root << " again" << endl;
+		closeIdentifierIndex(&index);
+		return 1;
+	}
+	if (found < 0)
+	{
+		cout << ">> No occurrences of " << name << " (" << us << " us)" << endl;
+		closeIdentifierIndex(&index);
+		return 1;
+	}
 
-	string input = "";
-	ifstream file(fileName);
+	ALLOCATION_PHASE(PHASE_OUTPUT);
+	const unsigned char *named = indexNameEntry(&index, found);
+	uint32_t first = getU32(named + 12);
+	uint32_t count = getU32(named + 16);
+	string out;
+	for (uint32_t o = first; o < first + count; o++)
+	{
+		const unsigned char *entry = indexOccurrenceEntry(&index, o);
+		const unsigned char *file = getU32(entry) < index.files ? indexFileEntry(&index, getU32(entry)) : nullptr;
+		if (file == nullptr || !indexStringFits(&index, getU32(file), getU32(file + 4)))
+		{
+			cout << "Error: the index under " << root << " is damaged, run --index " << root << " again" << endl;
+			closeIdentifierIndex(&index);
+			return 1;
+		}
+		out += string(indexString(&index, getU32(file), getU32(file + 4))) + ":" + to_string(getU32(entry + 4)) + ": " +
+			   (getU32(entry + 12) == ROLE_DECLARATION ? "declaration" : "use") + " (token " + to_string(getU32(entry + 8)) + ")\n";
+	}
+	cout << out << ">> " << count << " occurrences of " << name << ", found in " << us << " us" << endl;
+	closeIdentifierIndex(&index);
+	return 0;
+}
+
+/*============================ FORMATTER ====================================================================*/
+
+// --fmt path rewrites every .wika file at path, a file or a directory, in
+// the canonical layout; --fmt-check path only lists the files that are not
+// in it, and fails if there are any. The layout:
+//   - one tab of indentation per open {; a line that starts with } closes it
+//   - one space between the tokens of a line, but none before ; , ) ] or
+//     after ( [, none after a unary - + or !, none between a name and its (,
+//     and none inside ++ -- += -= *= /= %=
+//   - comments, strings and numbers are copied as written
+//   - line breaks stay where they are, runs of blank lines become one, and
+//     blank lines at either end and trailing spaces are dropped
+// The formatter is the sink tokenizeInto() passes spans to, so each token is
+// laid out as soon as it is lexed by copying its span of the source into a
+// buffer that is reused from file to file. No Token is ever built. The spacing never joins two
+// tokens into one, so the output lexes to the same tokens. A file with
+// lexical errors is left as it is.
+struct SourceFormatter
+{
+	string_view input;
+	string out;
+	size_t tokens;
+	int depth;	  // open braces
+	int newlines; // line breaks since the last token
+	bool glue;	  // the next token follows the last one without a space
+	TokenType previousType;
+	string_view previous; // span of the last token, empty at the start
+
+	size_t size() const { return tokens; }
+	void push_span(TokenType type, size_t start, size_t length);
+};
+
+void startFormatting(SourceFormatter *f, string_view input)
+{
+	f->input = input;
+	f->out.clear();
+	f->out.reserve(input.size() + input.size() / 8);
+	f->tokens = 0;
+	f->depth = 0;
+	f->newlines = 0;
+	f->glue = false;
+	f->previousType = NEWLINE;
+	f->previous = string_view();
+}
+
+// True when a + or - right after the previous token starts an operand
+bool startsOperand(TokenType type, string_view previous)
+{
+	if (previous.empty())
+		return true;
+	switch (type)
+	{
+	case ARITH_OP:
+	case ASSIGN_OP:
+	case REL_OP:
+	case LOG_OP:
+	case SEMICOLON:
+	case KEYWORD:
+	case RESERVED_WORD:
+		return true;
+	case DELIMITER:
+		return previous == "(" || previous == "[" || previous == "{" || previous == "}" || previous == ",";
+	default:
+		return false;
+	}
+}
+
+void SourceFormatter::push_span(TokenType type, size_t start, size_t length)
+{
+	tokens++;
+	if (type == NEWLINE)
+	{
+		newlines++;
+		return;
+	}
+
+	string_view text = input.substr(start, length);
+	// a // comment runs to the line break, which may follow trailing spaces
+	if (type == COMMENT && text[1] == '/')
+	{
+		while (isspace((unsigned char)text.back()))
+		{
+			text.remove_suffix(1);
+		}
+	}
+	bool lineStart = newlines > 0 || previous.empty();
+	bool unary = text == "!" || ((text == "-" || text == "+") && (lineStart || startsOperand(previousType, previous)));
+
+	if (lineStart)
+	{
+		if (!previous.empty())
+			out += newlines > 1 ? "\n\n" : "\n";
+		if (text == "}" && depth > 0)
+			depth--;
+		out.append(depth, '\t');
+	}
+	else
+	{
+		bool closes = text == ";" || text == "," || text == ")" || text == "]";
+		bool call = (text == "(" && (previousType == IDENTIFIER || previous == "tignan" || previous == "kunin")) || (text == "[" && previousType == IDENTIFIER);
+		// ++ -- and compound assignments written without a space stay joined
+		bool pair = start == (size_t)(previous.data() + previous.size() - input.data()) && previous.size() == 1 && text.size() == 1 &&
+					((previous == text && (text == "+" || text == "-")) || (text == "=" && string_view("+-*/%").find(previous[0]) != string_view::npos));
+		bool postfix = (text == "+" || text == "-") && start + 1 < input.size() && input[start + 1] == text[0] && (previousType == IDENTIFIER || previous == ")" || previous == "]");
+		// a space keeps ! = from being read back as != and - - as --
+		bool joins = (previous == "!" && text[0] == '=') || (previous == text && (text == "-" || text == "+"));
+		if (!((glue && !joins) || closes || call || pair || postfix))
+			out += ' ';
+		if (text == "}" && depth > 0)
+			depth--;
+	}
+	out.append(text);
+	if (text == "{")
+		depth++;
+
+	glue = text == "(" || text == "[" || unary;
+	newlines = 0;
+	previousType = type;
+	previous = text;
+}
+
+// Formats input; returns false, leaving out empty, when it has lexical errors
+bool formatSource(Analysis *analysis, SourceFormatter *f, string_view input)
+{
+	analysis->diagnostics.records.clear();
+	analysis->diagnostics.suppressed = 0;
+	startFormatting(f, input);
+	tokenizeInto<FormatLexer>(analysis, input, f);
+	if (!analysis->diagnostics.records.empty())
+	{
+		f->out.clear();
+		return false;
+	}
+	if (!f->out.empty())
+		f->out += '\n';
+	return true;
+}
+
+enum FormatResult
+{
+	FORMAT_UNCHANGED,
+	FORMAT_CHANGED,
+	FORMAT_LEXICAL_ERRORS,
+	FORMAT_IO_ERROR
+};
+
+FormatResult formatFile(Analysis *analysis, SourceFormatter *f, string *input, bool check)
+{
+	if (!readWholeFile(analysis->fileName, input))
+		return FORMAT_IO_ERROR;
+	startClock(&analysis->limits);
+	ALLOCATION_PHASE(PHASE_LEXER);
+	bool formatted = formatSource(analysis, f, *input);
+	ALLOCATION_PHASE(PHASE_OUTPUT);
+	if (!formatted)
+		return FORMAT_LEXICAL_ERRORS;
+	if (f->out == *input)
+		return FORMAT_UNCHANGED;
+	if (check)
+		return FORMAT_CHANGED;
+
+	// replace the file only once the formatted copy is complete
+	string temporary = analysis->fileName + ".fmt";
+	FILE *out = fopen(temporary.c_str(), "wb");
+	if (out == nullptr)
+		return FORMAT_IO_ERROR;
+	bool ok = fwrite(f->out.data(), 1, f->out.size(), out) == f->out.size();
+	ok = fclose(out) == 0 && ok;
+	if (!ok || rename(temporary.c_str(), analysis->fileName.c_str()) != 0)
+	{
+		remove(temporary.c_str());
+		return FORMAT_IO_ERROR;
+	}
+	return FORMAT_CHANGED;
+}
+
+// The files are split between the hardware threads, each with its own
+// Analysis, formatter and input buffer; results are printed in path order
+int formatTree(const Analysis *settings, const string &root, bool check)
+{
+	auto start = chrono::steady_clock::now();
+	vector<string> paths;
+	error_code error;
+	if (filesystem::is_directory(root, error))
+	{
+		for (filesystem::recursive_directory_iterator entry(root, error), end; !error && entry != end; entry.increment(error))
+		{
+			string path = entry->path().string();
+			if (isWikaFile(path) && !entry->is_directory(error))
+				paths.push_back(path);
+		}
+	}
+	else if (isWikaFile(root))
+		paths.push_back(root);
+	if (error || paths.empty())
+	{
+		cout << "Error: no .wika files at " << root << endl;
+		return 1;
+	}
+	sort(paths.begin(), paths.end());
+
+	int n = paths.size();
+	int chunks = max(1, min((int)thread::hardware_concurrency(), n));
+	vector<char> results(n);
+	parallelFor(chunks, [&](int t) {
+		SourceFormatter formatter;
+		string input;
+		for (int i = (long long)n * t / chunks; i < (long long)n * (t + 1) / chunks; i++)
+		{
+			Analysis analysis = analysisOf(settings, paths[i], "");
+			results[i] = formatFile(&analysis, &formatter, &input, check);
+		}
+	});
+
+	int changed = 0, failed = 0;
+	for (int i = 0; i < n; i++)
+	{
+		if (results[i] == FORMAT_CHANGED)
+		{
+			cout << paths[i] << endl;
+			changed++;
+		}
+		else if (results[i] == FORMAT_LEXICAL_ERRORS)
+		{
+			cout << paths[i] << ": not formatted, it has lexical errors" << endl;
+			failed++;
+		}
+		else if (results[i] == FORMAT_IO_ERROR)
+		{
+			cout << "Error: cannot " << (check ? "read " : "rewrite ") << paths[i] << endl;
+			failed++;
+		}
+	}
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	cout << ">> " << changed << " of " << n << " files " << (check ? "need formatting" : "formatted") << " in " << ms << " ms" << endl;
+	return failed > 0 || (check && changed > 0) ? 1 : 0;
+}
+
+/*============================ COMPRESSED INPUT =============================================================*/
+
+// A .wika.gz or .wika.zst file is decompressed by gzip or zstd. Its output
+// comes through a pipe straight into the input buffer, so the plain text is
+// never written to disk. The lexer needs the whole input, so it starts once
+// the decompressor has finished.
+string decompressorOf(const string &path)
+{
+	if (path.size() > 8 && path.compare(path.size() - 8, 8, ".wika.gz") == 0)
+		return "gzip -dc";
+	if (path.size() > 9 && path.compare(path.size() - 9, 9, ".wika.zst") == 0)
+		return "zstd -dc";
+	return "";
+}
+
+// Appends the decompressed text of path to input, ending it with a newline
+// like the line reader in main(). Reading stops past maxBytes (0 for no
+// limit), where the lexer only reports the size.
+bool readDecompressed(const string &decompressor, const string &path, size_t maxBytes, string *input)
+{
+	string command = decompressor + " " + shellQuote(path);
+#ifdef _WIN32
+	FILE *pipe = _popen(command.c_str(), "rb");
+#else
+	FILE *pipe = popen(command.c_str(), "r");
+#endif
+	if (pipe == nullptr)
+		return false;
+	char buffer[1 << 16];
+	size_t count;
+	bool truncated = false;
+	while ((count = fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+	{
+		input->append(buffer, count);
+		if (maxBytes > 0 && input->size() > maxBytes)
+		{
+			truncated = true;
+			break;
+		}
+	}
+	// a decompressor cut off early fails on the closed pipe, which is expected
+#ifdef _WIN32
+	bool ok = _pclose(pipe) == 0 || truncated;
+#else
+	bool ok = pclose(pipe) == 0 || truncated;
+#endif
+	if (!input->empty() && input->back() != '\n')
+		*input += '\n';
+	return ok;
+}
+
+/*============================ FUZZING ======================================================================*/
+
+// libFuzzer entry point, built instead of main():
+//
+//     clang++ -g -O1 -DWIKA_FUZZ -fsanitize=fuzzer,address,undefined parser.cpp -o wika_fuzz
+//     ./wika_fuzz -timeout=5 corpus/
+//
+// WIKA_FUZZ_TARGET=tokenize fuzzes the lexer alone, otherwise tokens are
+// also run through parse(). Setting WIKA_FUZZ_SCALING=<factor> also times
+// every input against the same input repeated eight times and aborts, so
+// libFuzzer saves the input, when the repeated run is more than factor
+// times slower than eight single runs.
+//
+// WIKA_FUZZ_THREADS=<n> also analyzes every input on n threads at once,
+// each with its own Analysis, and aborts when one of them disagrees with
+// the single run. Built with -fsanitize=fuzzer,thread instead, any state
+// the analyses still share is reported by ThreadSanitizer:
+//
+//     clang++ -g -O1 -DWIKA_FUZZ -fsanitize=fuzzer,thread parser.cpp -o wika_fuzz_threads
+//     WIKA_FUZZ_THREADS=8 ./wika_fuzz_threads -timeout=5 corpus/
+#ifdef WIKA_FUZZ
+
+// Returns a digest of the tokens, statements and diagnostics
+uint64_t fuzzTarget(const string &input, bool parseTokens)
+{
+	Analysis analysis = analysisOf(&defaultAnalysis, "", "");
+	vector<Token> tokens = tokenize<ReportLexer>(&analysis, input);
+	string text;
+	appendLineText(&text, &tokens, 0, tokens.size());
+	uint64_t digest = tokens.empty() ? 0 : hashLine(text);
+	if (parseTokens)
+	{
+		vector<Statement> statements = parse(&analysis, &tokens);
+		for (const Statement &statement : statements)
+		{
+			digest = (digest ^ ((uint64_t)statement.line << 1 | statement.validity)) * 1099511628211ULL;
+		}
+	}
+	for (const Diagnostic &diagnostic : analysis.diagnostics.records)
+	{
+		digest = (digest ^ (diagnostic.offset << 8 | diagnostic.code)) * 1099511628211ULL;
+	}
+	return digest;
+}
+
+double timeFuzzTarget(const string &input, bool parseTokens)
+{
+	// the fastest of three runs, to keep scheduler noise out of the ratio
+	double best = 0;
+	for (int run = 0; run < 3; run++)
+	{
+		auto start = chrono::steady_clock::now();
+		fuzzTarget(input, parseTokens);
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		if (run == 0 || seconds < best)
+			best = seconds;
+	}
+	return best;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	static const char *target = getenv("WIKA_FUZZ_TARGET");
+	static const char *scaling = getenv("WIKA_FUZZ_SCALING");
+	static const char *threads = getenv("WIKA_FUZZ_THREADS");
+	bool parseTokens = target == nullptr || strcmp(target, "tokenize") != 0;
+
+	string input((const char *)data, size);
+	uint64_t digest = fuzzTarget(input, parseTokens);
+
+	int concurrent = threads != nullptr ? atoi(threads) : 0;
+	if (concurrent > 1)
+	{
+		vector<uint64_t> digests(concurrent);
+		parallelFor(concurrent, [&](int t) { digests[t] = fuzzTarget(input, parseTokens); });
+		for (int t = 0; t < concurrent; t++)
+		{
+			if (digests[t] != digest)
+			{
+				fprintf(stderr, "analysis on thread %d differs from the single run\n", t);
+				abort();
+			}
+		}
+	}
+
+	double factor = scaling != nullptr ? atof(scaling) : 0;
+	if (factor > 0 && size > 0)
+	{
+		const int repeat = 8;
+		string repeated;
+		repeated.reserve(size * repeat);
+		for (int k = 0; k < repeat; k++)
+		{
+			repeated += input;
+		}
+		double once = timeFuzzTarget(input, parseTokens);
+		double many = timeFuzzTarget(repeated, parseTokens);
+		// runs under a millisecond are too short to judge
+		if (many > 0.001 && many > once * repeat * factor)
+		{
+			fprintf(stderr, "super-linear input: %zu bytes took %g s, %zu bytes took %g s\n", size, once, size * repeat, many);
+			abort();
+		}
+	}
+	return 0;
+}
+
+#else
+
+// --max-memory: the file is mapped instead of copied, tokens go to a
+// TokenStore and each statement is analyzed and printed as soon as it is
+// parsed, so neither the token stream nor the statements are held in full
+bool analyzeWithinBudget(Analysis *analysis, size_t budget)
+{
+	const string &fileName = analysis->fileName;
+	string_view input;
+#ifdef _WIN32
+	ifstream file(fileName, ios::binary);
+	string contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	input = contents;
+#else
+	int fd = open(fileName.c_str(), O_RDONLY);
+	struct stat info;
+	if (fd < 0 || fstat(fd, &info) != 0)
+	{
+		cout << "Error: file " << fileName << " not found." << endl;
+		return false;
+	}
+	void *map = nullptr;
+	if (info.st_size > 0)
+	{
+		map = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED)
+		{
+			cout << "Error: cannot map " << fileName << endl;
+			close(fd);
+			return false;
+		}
+		madvise(map, info.st_size, MADV_SEQUENTIAL);
+		input = string_view((const char *)map, info.st_size);
+	}
+	close(fd);
+#endif
 
-	size_t found = fileName.rfind(".wika");
+	startClock(&analysis->limits);
+	ALLOCATION_PHASE(PHASE_LEXER);
+	TokenStore tokens(budget);
+	tokenizeInto<ReportLexer>(analysis, input, &tokens);
+	// the line-by-line reader in main() ends every line with a newline;
+	// an input over --max-bytes leaves no tokens at all
+	bool lexed = analysis->diagnostics.records.empty() || analysis->diagnostics.records[0].code != DIAG_INPUT_TOO_LARGE;
+	if (!input.empty() && input.back() != '\n' && lexed)
+		tokens.push_back({NEWLINE, "\n", "New Line Character", input.size()});
+	ALLOCATION_PHASE(PHASE_OUTPUT);
+	printDiagnostics(analysis, input, cout, stdout);
+	printTokens(analysis, &tokens);
 
+	SymbolTable table;
+	initSymbolTable(&table);
+	printSyntaxHeader();
+	ALLOCATION_PHASE(PHASE_PARSER);
+	parseInto(analysis, &tokens, [&](Statement &statement) {
+		ALLOCATION_PHASE(PHASE_SEMANTIC);
+		analyzeStatement(&table, &tokens, &statement);
+		ALLOCATION_PHASE(PHASE_OUTPUT);
+		printStatement(statement);
+		ALLOCATION_PHASE(PHASE_PARSER);
+	});
+
+#ifndef _WIN32
+	if (map != nullptr)
+		munmap(map, info.st_size);
+#endif
 	cout << endl
-		 << endl
-		 << ">> Tokenizing "
-		 << fileName << "..."
-		 << endl
-		 << endl;
+		 << ">> Peak resident memory: " << peakResidentKilobytes() << " KB, "
+		 << tokens.spills << " of " << tokens.segments.size() << " token segments spilled, "
+		 << tokens.reloads << " reloaded" << endl;
+	return true;
+}
+
+// Test programs such as analysis_threads_test.cpp include this file with
+// WIKA_NO_MAIN defined and bring their own main()
+#ifndef WIKA_NO_MAIN
+int main(int argc, char *argv[])
+{
+	// ./a.out [file.wika | file.wika.gz | file.wika.zst] [--format table|ndjson|csv|binary] [--max-errors n]
+	//         [--max-memory bytes[K|M|G]] [--watch directory] [--syntax-only]
+	//         [--batch directory [--cold]] [--repl]
+	//         [--index directory] [--query directory identifier]
+	//         [--fmt file|directory | --fmt-check file|directory]
+	//         [--max-bytes bytes[K|M|G]] [--max-tokens n] [--max-identifier n]
+	//         [--max-string n] [--max-depth n] [--timeout ms]
+	//         [--run | --bench | --emit-c file.c | --native executable]
+	//         [--no-optimize] [--time-passes]
+	Analysis analysis = analysisOf(&defaultAnalysis, "clarence.wika", "output_symbol_table.wika");
+	bool run = false;
+	size_t maxMemory = 0;
+	string watchRoot = "";
+	string batchRoot = "";
+	bool cold = false;
+	bool repl = false;
+	string indexRoot = "";
+	string queryRoot = "";
+	string queryName = "";
+	string formatRoot = "";
+	bool formatCheck = false;
+	bool syntaxOnly = false;
+	bool bench = false;
+	string cFile = "";
+	string executable = "";
+	OutputFormat format = FORMAT_TABLE;
+	for (int a = 1; a < argc; a++)
+	{
+		string arg = argv[a];
+		if (arg == "--run")
+			run = true;
+		else if (arg == "--bench")
+			bench = true;
+		else if (arg == "--no-optimize")
+			optimize = false;
+		else if (arg == "--time-passes")
+			timePasses = true;
+		else if (arg == "--emit-c" && a + 1 < argc)
+			cFile = argv[++a];
+		else if (arg == "--native" && a + 1 < argc)
+			executable = argv[++a];
+		else if (arg == "--max-errors" && a + 1 < argc)
+			analysis.diagnostics.maxErrors = strtoull(argv[++a], nullptr, 10);
+		else if (arg == "--max-bytes" && a + 1 < argc)
+		{
+			if (!parseMemorySize(argv[++a], &analysis.limits.maxBytes))
+			{
+				cout << "Invalid size " << argv[a] << endl;
+				return 1;
+			}
+		}
+		else if (arg == "--max-tokens" && a + 1 < argc)
+			analysis.limits.maxTokens = strtoull(argv[++a], nullptr, 10);
+		else if (arg == "--max-identifier" && a + 1 < argc)
+			analysis.limits.maxIdentifier = strtoull(argv[++a], nullptr, 10);
+		else if (arg == "--max-string" && a + 1 < argc)
+			analysis.limits.maxString = strtoull(argv[++a], nullptr, 10);
+		else if (arg == "--max-depth" && a + 1 < argc)
+			analysis.limits.maxDepth = strtoull(argv[++a], nullptr, 10);
+		else if (arg == "--timeout" && a + 1 < argc)
+			analysis.limits.timeout = strtoll(argv[++a], nullptr, 10);
+		else if (arg == "--syntax-only")
+			syntaxOnly = true;
+		else if (arg == "--watch" && a + 1 < argc)
+			watchRoot = argv[++a];
+		else if (arg == "--batch" && a + 1 < argc)
+			batchRoot = argv[++a];
+		else if (arg == "--cold")
+			cold = true;
+		else if (arg == "--repl")
+			repl = true;
+		else if (arg == "--index" && a + 1 < argc)
+			indexRoot = argv[++a];
+		else if (arg == "--query" && a + 2 < argc)
+		{
+			queryRoot = argv[++a];
+			queryName = argv[++a];
+		}
+		else if ((arg == "--fmt" || arg == "--fmt-check") && a + 1 < argc)
+		{
+			formatRoot = argv[++a];
+			formatCheck = arg == "--fmt-check";
+		}
+		else if (arg == "--max-memory" && a + 1 < argc)
+		{
+			if (!parseMemorySize(argv[++a], &maxMemory) || maxMemory == 0)
+			{
+				cout << "Invalid memory size " << argv[a] << endl;
+				return 1;
+			}
+		}
+		else if (arg == "--format" && a + 1 < argc)
+		{
+			string name = argv[++a];
+			if (name == "ndjson")
+				format = FORMAT_NDJSON;
+			else if (name == "csv")
+				format = FORMAT_CSV;
+			else if (name == "binary")
+				format = FORMAT_BINARY;
+			else if (name != "table")
+			{
+				cout << "Unknown output format " << name << endl;
+				return 1;
+			}
+		}
+		else
+			analysis.fileName = arg;
+	}
+	if (!watchRoot.empty())
+		return watchTree(&analysis, watchRoot);
+	if (!batchRoot.empty())
+		return batchAnalyze(&analysis, batchRoot, cold);
+	if (repl)
+		return runRepl(&analysis);
+	if (!indexRoot.empty())
+		return buildIdentifierIndex(&analysis, indexRoot);
+	if (!queryRoot.empty())
+		return queryIdentifierIndex(queryRoot, queryName);
+	if (!formatRoot.empty())
+		return formatTree(&analysis, formatRoot, formatCheck);
+	// --emit-c with --native keeps the C file; --native alone builds from a temporary one
+	bool keepC = !cFile.empty();
+	if (!executable.empty() && cFile.empty())
+		cFile = executable + ".c";
+	bool execute = run || bench || !cFile.empty();
+	if (maxMemory > 0 && (execute || format != FORMAT_TABLE))
+	{
+		cout << "--max-memory only applies to the symbol table and syntax report" << endl;
+		return 1;
+	}
+	string decompressor = decompressorOf(analysis.fileName);
+	if (maxMemory > 0 && !decompressor.empty())
+	{
+		cout << "--max-memory maps the input, so it needs an uncompressed .wika file" << endl;
+		return 1;
+	}
 
-	if (found == string::npos && found != fileName.size() - 5)
+	const string &fileName = analysis.fileName;
+	string input = "";
+	ifstream file(fileName);
+
+	if (!execute && format == FORMAT_TABLE)
+	{
+		cout << endl
+			 << endl
+			 << ">> Tokenizing "
+			 << fileName << "..."
+			 << endl
+			 << endl;
+	}
+
+	if (!isWikaFile(fileName) && decompressor.empty())
 	{
 		cout << fileName << endl;
-		// '.wika' was not found in the file name, so we cannot accept the input
-		cout << "Only .wika files are accepted" << endl;
+		// the file name does not end in .wika, .wika.gz or .wika.zst, so we cannot accept the input
+		cout << "Only .wika, .wika.gz and .wika.zst files are accepted" << endl;
 	}
 	else
 	{
-		if (file.is_open())
+		if (file.is_open() && maxMemory > 0)
+		{
+			file.close();
+			return analyzeWithinBudget(&analysis, maxMemory) ? 0 : 1;
+		}
+		else if (file.is_open())
 		{
-			string line;
-			while (getline(file, line))
+			// past --max-bytes the lexer only reports the size, so stop reading there
+			file.close();
+			if (!decompressor.empty())
 			{
-				input += line + '\n';
+				if (!readDecompressed(decompressor, fileName, analysis.limits.maxBytes, &input))
+				{
+					cout << "Error: cannot decompress " << fileName << " with " << decompressor << endl;
+					return 1;
+				}
 			}
-			file.close();
-			vector<Token> tokens = tokenize(input);
-			printTokens(tokens);
-			vector<Statement> statements = parse(&tokens);
+			else
+			{
+				ifstream text(fileName);
+				string line;
+				while ((analysis.limits.maxBytes == 0 || input.size() <= analysis.limits.maxBytes) && getline(text, line))
+				{
+					input += line + '\n';
+				}
+			}
+			startClock(&analysis.limits);
+			ALLOCATION_PHASE(PHASE_LEXER);
+			vector<Token> tokens;
+			if (execute)
+				tokens = tokenize<ProgramLexer>(&analysis, input);
+			else if (syntaxOnly)
+				tokens = tokenize<SyntaxLexer>(&analysis, input);
+			else
+				tokens = tokenize<ReportLexer>(&analysis, input);
+			ALLOCATION_PHASE(PHASE_OUTPUT);
+			if (format == FORMAT_TABLE && !execute)
+				printDiagnostics(&analysis, input, cout, stdout);
+			else
+				printDiagnostics(&analysis, input, cerr, stderr);
+			ALLOCATION_PHASE(PHASE_PROGRAM);
+			if (!cFile.empty())
+			{
+				return compileNative(&analysis, &tokens, cFile, executable, keepC) ? 0 : 1;
+			}
+			if (run || bench)
+			{
+				return runProgram(&analysis, &tokens, bench) ? 0 : 1;
+			}
+			if (format != FORMAT_TABLE && !syntaxOnly)
+			{
+				// the token table goes to output_symbol_table.<format>, the
+				// statement report to standard output
+				static const char *extensions[] = {"", ".ndjson", ".csv", ".bin"};
+				string tableFileName = analysis.outputFileName.substr(0, analysis.outputFileName.rfind(".wika")) + extensions[format];
+				FILE *table = fopen(tableFileName.c_str(), "wb");
+				if (table == nullptr)
+				{
+					cout << "Error: cannot write " << tableFileName << endl;
+					return 1;
+				}
+				ALLOCATION_PHASE(PHASE_OUTPUT);
+				bool written = writeTokens(&analysis, table, tokens, format);
+				if (fclose(table) != 0 || !written)
+				{
+					cout << "Error: could not write " << tableFileName << endl;
+					return 1;
+				}
+				ALLOCATION_PHASE(PHASE_PARSER);
+				vector<Statement> statements = parse(&analysis, &tokens);
+				ALLOCATION_PHASE(PHASE_SEMANTIC);
+				analyze(&tokens, &statements);
+				ALLOCATION_PHASE(PHASE_OUTPUT);
+				return writeSyntax(stdout, statements, format) ? 0 : 1;
+			}
+			ALLOCATION_PHASE(PHASE_OUTPUT);
+			if (!syntaxOnly)
+				printTokens(&analysis, tokens, true);
+			ALLOCATION_PHASE(PHASE_PARSER);
+			vector<Statement> statements = parse(&analysis, &tokens);
+			ALLOCATION_PHASE(PHASE_SEMANTIC);
+			analyze(&tokens, &statements);
+			ALLOCATION_PHASE(PHASE_OUTPUT);
+			if (format != FORMAT_TABLE)
+				return writeSyntax(stdout, statements, format) ? 0 : 1;
 			printSyntax(statements);
 		}
 		else
@@ -789,3 +6991,6 @@ int main()
 
 	return 0;
 }
+#endif
+
+#endif
@@ -0,0 +1,293 @@
+/*
+	# Symbol table output shared by lexer.cpp and parser.cpp
+
+	Header only, included after lexer.hpp. Formats the tokens of an analysis
+	as the tab-separated symbol table and writes it on the threads of a pool
+	that parser.cpp also parses with.
+	lexer.cpp lists INDEX, TOKEN, TYPE and DESCRIPTION; parser.cpp, whose
+	lexer records positions, adds the LINE of each token in front.
+*/
+
+#ifndef WIKA_TOKEN_TABLE_HPP
+#define WIKA_TOKEN_TABLE_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <charconv>
+#include <cerrno>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+#include "lexer.hpp"
+
+using namespace std;
+
+// TYPE column of the symbol table, tab padding included, indexed by TokenType
+const string tokenTypeColumns[] = {
+	"DATA_TYPE\t\t\t",
+	"KEYWORD\t\t\t",
+	"RESERVED_WORD\t\t",
+	"IDENTIFIER\t\t",
+	"CONSTANT\t\t",
+	"ASSIGN_OP\t\t\t",
+	"ARITH_OP\t\t\t\t",
+	"REL_OP\t\t\t",
+	"LOG_OP\t\t\t",
+	"COMMENT\t\t\t\t",
+	"DELIMITER\t\t\t\t",
+	"SEMICOLON\t\t\t\t",
+	"",
+};
+
+const string symbolTableHeader = "\nINDEX\t\t\tTOKEN\t\t\t\tTYPE\t\t\tDESCRIPTION\t\t\n";
+const string lineSymbolTableHeader = "\nLINE\t\t\tINDEX\t\t\tTOKEN\t\t\t\tTYPE\t\t\tDESCRIPTION\t\t\n";
+
+int digits(long long value)
+{
+	int count = 1;
+	while (value >= 10)
+	{
+		value /= 10;
+		count++;
+	}
+	return count;
+}
+
+// Size of the row appendTokenRow() writes; line is 0 for a table without
+// the LINE column
+size_t tokenRowSize(const Token &token, int index, size_t line)
+{
+	return (line > 0 ? digits(line) + 3 : 0) + digits(index) + 3 + token.value.size() + 4 + tokenTypeColumns[token.type].size() + token.description.size() + 1;
+}
+
+void appendTokenRow(string *out, const Token &token, int index, size_t line)
+{
+	char number[24];
+	if (line > 0)
+	{
+		out->append(number, to_chars(number, number + sizeof(number), line).ptr);
+		out->append("\t\t\t");
+	}
+	out->append(number, to_chars(number, number + sizeof(number), index).ptr);
+	out->append("\t\t\t");
+	out->append(token.value);
+	out->append("\t\t\t\t");
+	out->append(tokenTypeColumns[token.type]);
+	out->append(token.description);
+	out->push_back('\n');
+}
+
+// One parallelFor() call. Chunks are claimed through next, by the caller
+// and by any worker that picks up one of its tickets, so a ticket that
+// runs after every chunk was claimed does nothing.
+struct ParallelJob
+{
+	const function<void(int)> *body;
+	int chunks;
+	atomic<int> next;
+	int finished;
+	mutex lock;
+	condition_variable done;
+};
+
+// Workers started on the first parallelFor() and kept for the rest of the
+// process, so repeated parses and table writes do not pay for new threads
+struct ThreadPool
+{
+	mutex lock;
+	condition_variable work;
+	deque<shared_ptr<ParallelJob>> tickets;
+};
+
+// Runs the chunks of job that are still unclaimed
+void runChunks(ParallelJob *job)
+{
+	int t;
+	while ((t = job->next++) < job->chunks)
+	{
+		(*job->body)(t);
+		lock_guard<mutex> held(job->lock);
+		if (++job->finished == job->chunks)
+			job->done.notify_all();
+	}
+}
+
+ThreadPool *threadPool()
+{
+	// never destroyed: workers may still be waiting when the process exits
+	static ThreadPool *pool = [] {
+		ThreadPool *created = new ThreadPool;
+		int workers = max(1, (int)thread::hardware_concurrency() - 1);
+		for (int w = 0; w < workers; w++)
+		{
+			thread([created] {
+				while (true)
+				{
+					shared_ptr<ParallelJob> job;
+					{
+						unique_lock<mutex> held(created->lock);
+						created->work.wait(held, [&] { return !created->tickets.empty(); });
+						job = move(created->tickets.front());
+						created->tickets.pop_front();
+					}
+					runChunks(job.get());
+				}
+			}).detach();
+		}
+		return created;
+	}();
+	return pool;
+}
+
+// Runs body(0) .. body(chunks - 1) on the pool and the calling thread. The
+// caller works through unclaimed chunks itself before it waits, so a body
+// may call parallelFor() again without starving the pool.
+void parallelFor(int chunks, const function<void(int)> &body)
+{
+	if (chunks <= 1)
+	{
+		body(0);
+		return;
+	}
+	shared_ptr<ParallelJob> job = make_shared<ParallelJob>();
+	job->body = &body;
+	job->chunks = chunks;
+	job->next = 0;
+	job->finished = 0;
+	ThreadPool *pool = threadPool();
+	{
+		lock_guard<mutex> held(pool->lock);
+		for (int t = 1; t < chunks; t++)
+		{
+			pool->tickets.push_back(job);
+		}
+	}
+	pool->work.notify_all();
+	runChunks(job.get());
+	unique_lock<mutex> held(job->lock);
+	job->done.wait(held, [&] { return job->finished == chunks; });
+}
+
+bool writeAt(int fd, const string &buffer, size_t offset)
+{
+	size_t written = 0;
+	while (written < buffer.size())
+	{
+#ifdef _WIN32
+		// there is no pwrite, so seek and write must not interleave between threads
+		static mutex seekLock;
+		lock_guard<mutex> lock(seekLock);
+		if (_lseeki64(fd, offset + written, SEEK_SET) < 0)
+			return false;
+		int count = _write(fd, buffer.data() + written, buffer.size() - written);
+#else
+		ssize_t count = pwrite(fd, buffer.data() + written, buffer.size() - written, offset + written);
+#endif
+		if (count < 0 && errno == EINTR)
+			continue;
+		if (count <= 0)
+			return false;
+		written += count;
+	}
+	return true;
+}
+
+const int minTokensPerThread = 1 << 16;
+
+// Writes the symbol table to the analysis' output file, with the LINE
+// column when lines is true. The table is cut into contiguous token ranges.
+// A first parallel pass measures every range so each one knows its byte
+// offset in the file, then each thread formats its range and writes it in
+// place with pwrite. The output is byte-for-byte the same as formatting the
+// rows one by one.
+void printTokens(Analysis *analysis, const vector<Token> &tokens, bool lines)
+{
+	const string &outputFileName = analysis->outputFileName;
+	const string &header = lines ? lineSymbolTableHeader : symbolTableHeader;
+#ifdef _WIN32
+	int fd = _open(outputFileName.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+	int fd = open(outputFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+	if (fd >= 0)
+	{
+		int n = tokens.size();
+		int chunks = max(1, min((int)thread::hardware_concurrency(), n / minTokensPerThread));
+		vector<size_t> offsets(chunks + 1, 0);
+
+		// build the line index before the threads share it
+		if (lines)
+			lineAt(&analysis->lines, 0);
+		// line of the first token of range t, or 0 without the LINE column
+		auto firstLine = [&](int first) -> size_t {
+			if (!lines)
+				return 0;
+			return first < n ? lineAt(&analysis->lines, tokens[first].offset) : 1;
+		};
+		parallelFor(chunks, [&](int t) {
+			size_t size = 0;
+			int first = (long long)n * t / chunks;
+			size_t line = firstLine(first);
+			for (int i = first; i < (long long)n * (t + 1) / chunks; i++)
+			{
+				if (lines)
+					line = advanceLine(&analysis->lines, line, tokens[i].offset);
+				size += tokenRowSize(tokens[i], i, line);
+			}
+			offsets[t + 1] = size;
+		});
+		offsets[0] = header.size();
+		for (int t = 1; t <= chunks; t++)
+		{
+			offsets[t] += offsets[t - 1];
+		}
+
+		bool ok = writeAt(fd, header, 0);
+		vector<char> written(chunks, 0);
+		parallelFor(chunks, [&](int t) {
+			string buffer;
+			buffer.reserve(offsets[t + 1] - offsets[t]);
+			int first = (long long)n * t / chunks;
+			size_t line = firstLine(first);
+			for (int i = first; i < (long long)n * (t + 1) / chunks; i++)
+			{
+				if (lines)
+					line = advanceLine(&analysis->lines, line, tokens[i].offset);
+				appendTokenRow(&buffer, tokens[i], i, line);
+			}
+			written[t] = writeAt(fd, buffer, offsets[t]);
+		});
+		for (int t = 0; t < chunks; t++)
+		{
+			ok = ok && written[t];
+		}
+		if (!ok)
+		{
+			cout << "Error: could not write " << outputFileName << endl;
+		}
+#ifdef _WIN32
+		_close(fd);
+#else
+		close(fd);
+#endif
+	}
+	cout << ">> Generating output symbol table..." << endl
+		 << endl;
+	cout << ">> Output file generated: " << outputFileName << endl
+		 << endl;
+}
+
+#endif